@@ -0,0 +1,136 @@
+/* bootstat.c - time the phases of booting */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301, USA.
+ */
+
+/*
+ *  Each phase records when it was entered first, how long was spent in
+ *  it altogether, how many times it ran and how many bytes it moved.
+ *  The times are in microseconds since grub_efi_init_time.  Phases may
+ *  nest: the time of reading a kernel includes its decompression and
+ *  the firmware reads below both.
+ */
+
+#include <config.h>
+#include <grub/misc.h>
+#include <grub/efi/time.h>
+
+#include <shared.h>
+
+struct bootstat_phase
+{
+  grub_uint64_t first;
+  grub_uint64_t total;
+  /* When the current run of the phase began.  */
+  grub_uint64_t start;
+  unsigned long count;
+  unsigned long bytes;
+};
+
+static char *bootstat_names[BOOTSTAT_NUM] =
+{
+  "config",
+  "disks",
+  "mount",
+  "kernel",
+  "initrd",
+  "decompress",
+  "diskread",
+  "ebs"
+};
+
+static struct bootstat_phase bootstat_phases[BOOTSTAT_NUM];
+
+/* Non-zero if the timeline is passed on the Linux command line.  */
+int bootstat_export;
+
+void
+bootstat_begin (int phase)
+{
+  struct bootstat_phase *p = bootstat_phases + phase;
+
+  p->start = grub_get_time_us ();
+  if (! p->count)
+    p->first = p->start;
+}
+
+void
+bootstat_end (int phase, unsigned long bytes)
+{
+  struct bootstat_phase *p = bootstat_phases + phase;
+
+  p->total += grub_get_time_us () - p->start;
+  p->count++;
+  p->bytes += bytes;
+}
+
+void
+bootstat_print (void)
+{
+  int i;
+
+  grub_printf (" %lu us since startup\n",
+	       (unsigned long) grub_get_time_us ());
+
+  for (i = 0; i < BOOTSTAT_NUM; i++)
+    {
+      struct bootstat_phase *p = bootstat_phases + i;
+
+      if (! p->count)
+	continue;
+
+      grub_printf (" %s: %lu us in %lu runs, first at %lu us",
+		   bootstat_names[i], (unsigned long) p->total, p->count,
+		   (unsigned long) p->first);
+      if (p->bytes)
+	grub_printf (", %lu bytes", p->bytes);
+      grub_printf ("\n");
+    }
+}
+
+/* Append " grub.bootstat=NAME:FIRST+TOTAL,..." to CMDLINE, leaving out
+   the phases which would make it longer than SIZE bytes including the
+   terminating NUL.  */
+void
+bootstat_append_cmdline (char *cmdline, int size)
+{
+  char item[64];
+  char *end = cmdline + grub_strlen (cmdline);
+  int i, sep = ' ';
+
+  for (i = 0; i < BOOTSTAT_NUM; i++)
+    {
+      struct bootstat_phase *p = bootstat_phases + i;
+      int len;
+
+      if (! p->count)
+	continue;
+
+      len = grub_sprintf (item, "%c%s%s:%lu+%lu", sep,
+			  sep == ' ' ? "grub.bootstat=" : "",
+			  bootstat_names[i], (unsigned long) p->first,
+			  (unsigned long) p->total);
+      if (end + len >= cmdline + size)
+	break;
+
+      grub_memmove (end, item, len + 1);
+      end += len;
+      sep = ',';
+    }
+}
@@ -54,6 +54,7 @@ grub_chainloader_boot (void)
   grub_efi_uintn_t exit_data_size = 0;
   grub_efi_char16_t *exit_data = NULL;
 
+  grub_console_flush ();
   b = grub_efi_system_table->boot_services;
   status = Call_Service_3 (b->start_image, image_handle,
 			   &exit_data_size, &exit_data);
@@ -38,14 +38,58 @@ grub_console_highlight_color = GRUB_EFI_TEXT_ATTR (GRUB_EFI_BLACK,
 
 static int read_key = -1;
 
+/* Output is gathered here and handed to the firmware a line at a time,
+   since each call to output_string can be slow, above all when the
+   console is redirected to a serial port.  Anything that depends on or
+   moves the cursor, or waits for input, flushes it first.  */
+#define CONSOLE_BUFSIZE	128
+
+static grub_efi_char16_t console_buf[CONSOLE_BUFSIZE + 1];
+static int console_buf_len;
+
+/* What test_string said about each character, so that it is asked only
+   once per character.  */
+static grub_uint8_t char_tested[0x10000 / 8];
+static grub_uint8_t char_supported[0x10000 / 8];
+
 void
-console_putchar (int c)
+grub_console_flush (void)
 {
-  grub_efi_char16_t str[2];
   grub_efi_simple_text_output_interface_t *o;
 
+  if (! console_buf_len)
+    return;
+
   o = grub_efi_system_table->con_out;
+  console_buf[console_buf_len] = 0;
+  console_buf_len = 0;
+  Call_Service_2 (o->output_string, o, console_buf);
+}
 
+static int
+console_char_supported (int c)
+{
+  grub_efi_char16_t str[2];
+  grub_efi_simple_text_output_interface_t *o;
+  int mask = 1 << (c & 7);
+
+  if (! (char_tested[c >> 3] & mask))
+    {
+      o = grub_efi_system_table->con_out;
+      str[0] = (grub_efi_char16_t) c;
+      str[1] = 0;
+
+      char_tested[c >> 3] |= mask;
+      if (Call_Service_2 (o->test_string, o, str) == GRUB_EFI_SUCCESS)
+	char_supported[c >> 3] |= mask;
+    }
+
+  return char_supported[c >> 3] & mask;
+}
+
+void
+console_putchar (int c)
+{
   switch (c)
     {
     case DISP_LEFT:
@@ -84,14 +128,12 @@ console_putchar (int c)
   if (c > 0xffff)
     c = '?';
 
-  str[0] = (grub_efi_char16_t)  (c & 0xffff);
-  str[1] = 0;
-
-  /* Should this test be cached?  */
-  if (c > 0x7f && Call_Service_2 (o->test_string, o, str) != GRUB_EFI_SUCCESS)
+  if (c > 0x7f && ! console_char_supported (c))
     return;
 
-  Call_Service_2 (o->output_string, o, str);
+  console_buf[console_buf_len++] = (grub_efi_char16_t) c;
+  if (c == '\n' || console_buf_len == CONSOLE_BUFSIZE)
+    grub_console_flush ();
 }
 
 int
@@ -104,6 +146,7 @@ console_checkkey (void)
   if (read_key >= 0)
     return 1;
 
+  grub_console_flush ();
   i = grub_efi_system_table->con_in;
   status = Call_Service_2 (i->read_key_stroke ,i, &key);
 #if 0
@@ -193,6 +236,7 @@ console_getkey (void)
       return key;
     }
 
+  grub_console_flush ();
   i = grub_efi_system_table->con_in;
   b = grub_efi_system_table->boot_services;
 
@@ -223,6 +267,7 @@ console_getxy (void)
 {
   grub_efi_simple_text_output_interface_t *o;
 
+  grub_console_flush ();
   o = grub_efi_system_table->con_out;
   return ((o->mode->cursor_column << 8) | o->mode->cursor_row);
 }
@@ -232,6 +277,7 @@ console_gotoxy (int x, int y)
 {
   grub_efi_simple_text_output_interface_t *o;
 
+  grub_console_flush ();
   o = grub_efi_system_table->con_out;
   Call_Service_3 (o->set_cursor_position , o, x, y);
 }
@@ -242,6 +288,8 @@ console_cls (void)
   grub_efi_simple_text_output_interface_t *o;
   grub_efi_int32_t orig_attr;
 
+  /* Nothing is lost; the screen is about to be cleared anyway.  */
+  console_buf_len = 0;
   o = grub_efi_system_table->con_out;
   orig_attr = o->mode->attribute;
   Call_Service_2 (o->set_attributes, o, GRUB_EFI_BACKGROUND_BLACK);
@@ -254,6 +302,7 @@ console_setcolorstate (color_state state)
 {
   grub_efi_simple_text_output_interface_t *o;
 
+  grub_console_flush ();
   o = grub_efi_system_table->con_out;
 
   switch (state) {
@@ -283,6 +332,7 @@ console_setcursor (int on)
 {
   grub_efi_simple_text_output_interface_t *o;
 
+  grub_console_flush ();
   o = grub_efi_system_table->con_out;
   Call_Service_2 (o->enable_cursor, o, on);
   return on;
@@ -303,4 +353,5 @@ grub_console_init (void)
 void
 grub_console_fini (void)
 {
+  grub_console_flush ();
 }
@@ -232,6 +232,46 @@ grub_get_rtc (void)
 	  * GRUB_TICKS_PER_SECOND / 1000);
 }
 
+/* The monotonic clock.  GetTime is slow on many machines and its value
+   wraps every hour, so count the time stamp counter instead, after
+   measuring its rate against Stall once.  */
+
+#define TSC_CALIBRATE_US	10000
+
+static grub_uint64_t tsc_base;
+/* The TSC ticks per millisecond, or zero if the TSC is not usable.  */
+static grub_uint64_t tsc_per_ms;
+
+static inline grub_uint64_t
+grub_rdtsc (void)
+{
+  grub_uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((grub_uint64_t) hi << 32) | lo;
+}
+
+void
+grub_efi_init_time (void)
+{
+  grub_uint64_t start;
+
+  start = grub_rdtsc ();
+  grub_efi_stall (TSC_CALIBRATE_US);
+  tsc_per_ms = (grub_rdtsc () - start) / (TSC_CALIBRATE_US / 1000);
+  tsc_base = start;
+}
+
+grub_uint64_t
+grub_get_time_us (void)
+{
+  if (! tsc_per_ms)
+    return ((grub_uint64_t) grub_get_rtc () * 1000000
+	    / GRUB_TICKS_PER_SECOND);
+
+  return (grub_rdtsc () - tsc_base) * 1000 / tsc_per_ms;
+}
+
 grub_efi_device_path_t *
 grub_efi_get_device_path (grub_efi_handle_t handle)
 {
@@ -32,6 +32,15 @@ struct grub_efidisk_data
   grub_efi_device_path_t *last_device_path;
   grub_efi_block_io_t *block_io;
   grub_efi_disk_io_t *disk_io;
+  /* The sector size and its log2, valid while the media id matches.  */
+  grub_efi_uint32_t media_id;
+  int sector_size;
+  int sector_bits;
+  /* The media seen by the last efidisk_media_changed, which stays with
+     the drive number when devices are swapped.  */
+  int media_seen;
+  grub_efi_uint32_t seen_media_id;
+  grub_efi_lba_t seen_last_block;
   struct grub_efidisk_data *next;
 };
 
@@ -44,6 +53,11 @@ static struct grub_efidisk_data *fd_devices;
 static struct grub_efidisk_data *hd_devices;
 static struct grub_efidisk_data *cd_devices;
 
+/* The devices indexed by drive number, to avoid walking the lists on
+   every disk access.  */
+static struct grub_efidisk_data *fd_table[MAX_HD_NUM];
+static struct grub_efidisk_data *hd_table[MAX_HD_NUM];
+
 static int get_device_sector_bits(struct grub_efidisk_data *device);
 static int get_device_sector_size(struct grub_efidisk_data *device);
 static struct grub_efidisk_data *get_device_from_drive (int drive);
@@ -101,6 +115,7 @@ make_devices (void)
       d->last_device_path = ldp;
       d->block_io = bio;
       d->disk_io = dio;
+      d->sector_size = 0;
       d->next = devices;
       devices = d;
     }
@@ -227,46 +242,73 @@ free_devices (struct grub_efidisk_data *devices)
     }
 }
 
-/* Enumerate all disks to name devices.  */
+/* Fill TABLE with the first entries of the list DEVICES.  */
 static void
-enumerate_disks (void)
+index_devices (struct grub_efidisk_data **table,
+	       struct grub_efidisk_data *devices)
 {
-  struct grub_efidisk_data *devices;
-
-  devices = make_devices ();
-  if (! devices)
-    return;
+  int i;
 
-  name_devices (devices);
-  free_devices (devices);
+  for (i = 0; i < MAX_HD_NUM; i++)
+    {
+      table[i] = devices;
+      if (devices)
+	devices = devices->next;
+    }
 }
 
-static struct grub_efidisk_data *
-get_device (struct grub_efidisk_data *devices, int num)
+/* Enumerate all disks to name devices.  */
+static void
+enumerate_disks (void)
 {
-  struct grub_efidisk_data *d;
+  struct grub_efidisk_data *devices;
 
-  for (d = devices; d && num; d = d->next, num--)
-    ;
+  bootstat_begin (BOOTSTAT_DISKS);
 
-  if (num == 0)
-    return d;
+  devices = make_devices ();
+  if (devices)
+    {
+      name_devices (devices);
+      free_devices (devices);
 
-  return 0;
+      index_devices (fd_table, fd_devices);
+      index_devices (hd_table, hd_devices);
+    }
+
+  bootstat_end (BOOTSTAT_DISKS, 0);
 }
 
 static int
 grub_efidisk_read (struct grub_efidisk_data *d, grub_disk_addr_t sector,
 		   grub_size_t size, char *buf)
 {
-  /* For now, use the disk io interface rather than the block io's.  */
   grub_efi_disk_io_t *dio;
   grub_efi_block_io_t *bio;
   grub_efi_status_t status;
   grub_efi_uint64_t sector_size = get_device_sector_size(d);
+  grub_efi_uint32_t io_align;
+  int ret = 0;
 
   dio = d->disk_io;
   bio = d->block_io;
+  io_align = bio->media->io_align;
+
+  bootstat_begin (BOOTSTAT_DISK_READ);
+
+  /* Prefer the block io interface, which transfers the whole request at
+     once, while many disk io implementations bounce and split it.  The
+     block io requires BUF to be aligned to IO_ALIGN, so use the disk io
+     for unaligned buffers or if the block io fails.  */
+  if (io_align <= 1 || ((grub_addr_t) buf & (io_align - 1)) == 0)
+    {
+      status = Call_Service_5 (bio->read_blocks,
+			       bio, bio->media->media_id,
+			       sector,
+			       size * sector_size,
+			       buf);
+      if (status == GRUB_EFI_SUCCESS)
+	goto out;
+    }
 
   status = Call_Service_5 (dio->read,
 			   dio, bio->media->media_id,
@@ -274,9 +316,11 @@ grub_efidisk_read (struct grub_efidisk_data *d, grub_disk_addr_t sector,
 			   size * sector_size,
 			   buf);
   if (status != GRUB_EFI_SUCCESS)
-    return -1;
+    ret = -1;
 
-  return 0;
+ out:
+  bootstat_end (BOOTSTAT_DISK_READ, ret ? 0 : size * sector_size);
+  return ret;
 }
 
 static int
@@ -319,19 +363,9 @@ grub_efidisk_fini (void)
   free_devices (fd_devices);
   free_devices (hd_devices);
   free_devices (cd_devices);
-}
-
-static int
-get_device_sector_size(struct grub_efidisk_data *device)
-{
-	return device->block_io->media->block_size;
-}
-
-int
-get_sector_size(int drive)
-{
-	struct grub_efidisk_data *device = get_device_from_drive(drive);
-	return get_device_sector_size(device);
+  fd_devices = hd_devices = cd_devices = 0;
+  index_devices (fd_table, 0);
+  index_devices (hd_table, 0);
 }
 
 /*
@@ -348,18 +382,53 @@ ffz (unsigned int word)
 }
 #define log2(n) ffz(~(n))
 
+/* Recompute the cached sector size of DEVICE if its media has changed.  */
+static inline void
+update_device_sector_size (struct grub_efidisk_data *device)
+{
+  grub_efi_block_io_media_t *m = device->block_io->media;
+
+  if (device->sector_size && device->media_id == m->media_id)
+    return;
+
+  device->media_id = m->media_id;
+  device->sector_size = m->block_size;
+  device->sector_bits = log2 (m->block_size);
+}
+
+static int
+get_device_sector_size(struct grub_efidisk_data *device)
+{
+  update_device_sector_size (device);
+  return device->sector_size;
+}
+
 static int
 get_device_sector_bits(struct grub_efidisk_data *device)
 {
-	int sector_size = get_device_sector_size(device);
-	return log2(sector_size);
+  update_device_sector_size (device);
+  return device->sector_bits;
+}
+
+int
+get_sector_size(int drive)
+{
+  struct grub_efidisk_data *device = get_device_from_drive(drive);
+
+  /* Not a disk, e.g. the network drive.  */
+  if (! device)
+    return 0x200;
+  return get_device_sector_size(device);
 }
 
 int
 get_sector_bits(int drive)
 {
-	int sector_size = get_sector_size(drive);
-	return log2(sector_size);
+  struct grub_efidisk_data *device = get_device_from_drive(drive);
+
+  if (! device)
+    return 9;
+  return get_device_sector_bits(device);
 }
 
 static struct grub_efidisk_data *
@@ -373,13 +442,13 @@ get_device_from_drive (int drive)
   if (drive == GRUB_INVALID_DRIVE)
     return NULL;
   if (drive == cdrom_drive)
-    return get_device (cd_devices, 0);
+    return cd_devices;
   /* Hard disk */
   if (drive & 0x80)
-    return get_device (hd_devices, drive - 0x80);
+    return ((drive - 0x80) < MAX_HD_NUM) ? hd_table[drive - 0x80] : NULL;
   /* Floppy disk */
   else
-    return get_device (fd_devices, drive);
+    return (drive < MAX_HD_NUM) ? fd_table[drive] : NULL;
 }
 
 /* Low-level disk I/O.  Our stubbed version just returns a file
@@ -406,7 +475,7 @@ get_diskinfo (int drive, struct geometry *geometry)
 
 int
 biosdisk (int subfunc, int drive, struct geometry *geometry,
-	  int sector, int nsec, int segment)
+	  grub_sector_t sector, int nsec, int segment)
 {
   char *buf;
   struct grub_efidisk_data *d;
@@ -428,7 +497,45 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
       return -1;
     }
 
-  return 0;
+  return ret;
+}
+
+/* Read NSEC sectors starting from SECTOR on DRIVE directly into BUF,
+   which can be anywhere in memory.  Return non-zero on failure.  */
+int
+efidisk_read (int drive, grub_sector_t sector, int nsec, char *buf)
+{
+  struct grub_efidisk_data *d;
+
+  d = get_device_from_drive (drive);
+  if (!d)
+    return -1;
+
+  return grub_efidisk_read (d, sector, nsec, buf);
+}
+
+/* Return non-zero if the media in DRIVE is not the one seen by the
+   previous call, so anything cached about it is stale.  */
+int
+efidisk_media_changed (int drive)
+{
+  struct grub_efidisk_data *d;
+  grub_efi_block_io_media_t *m;
+  int changed;
+
+  d = get_device_from_drive (drive);
+  if (!d)
+    return 0;
+
+  m = d->block_io->media;
+  changed = (d->media_seen
+	     && (d->seen_media_id != m->media_id
+		 || d->seen_last_block != m->last_block));
+
+  d->media_seen = 1;
+  d->seen_media_id = m->media_id;
+  d->seen_last_block = m->last_block;
+  return changed;
 }
 
 /* Some utility functions to map GRUB devices with EFI devices.  */
@@ -501,8 +608,8 @@ grub_get_drive_partition_from_bdev_handle (grub_efi_handle_t handle,
   grub_efi_hard_drive_device_path_t hd;
   int found;
   int part_type, part_entry;
-  unsigned long partition_start, partition_len, part_offset, part_extoffset;
-  unsigned long gpt_offset;
+  grub_part_sector_t partition_start, partition_len, gpt_offset;
+  unsigned long part_offset, part_extoffset;
   int gpt_count, gpt_size;
   auto int find_bdev (struct grub_efidisk_data *c);
 
@@ -608,11 +715,11 @@ grub_get_drive_partition_from_bdev_handle (grub_efi_handle_t handle,
 
   char buf[get_sector_size(drv)];
   part = 0xFFFFFF;
-  while (next_partition (drv, 0, &part, &part_type,
-			 &partition_start, &partition_len,
-			 &part_offset, &part_entry,
-			 &part_extoffset, &gpt_offset, &gpt_count,
-			 &gpt_size, buf))
+  while (next_cached_partition (drv, 0, &part, &part_type,
+				&partition_start, &partition_len,
+				&part_offset, &part_entry,
+				&part_extoffset, &gpt_offset, &gpt_count,
+				&gpt_size, buf))
     {
       if (part_type
 	  && partition_start == hd.partition_start)
@@ -655,12 +762,18 @@ swap_devices (struct grub_efidisk_data *d0,
   d0->last_device_path = d1->last_device_path;
   d0->block_io = d1->block_io;
   d0->disk_io = d1->disk_io;
+  d0->media_id = d1->media_id;
+  d0->sector_size = d1->sector_size;
+  d0->sector_bits = d1->sector_bits;
 
   memcpy(d1->handle, tmp.handle, sizeof(tmp.handle));
   d1->device_path = tmp.device_path;
   d1->last_device_path = tmp.last_device_path;
   d1->block_io = tmp.block_io;
   d1->disk_io = tmp.disk_io;
+  d1->media_id = tmp.media_id;
+  d1->sector_size = tmp.sector_size;
+  d1->sector_bits = tmp.sector_bits;
 }
 
 static int
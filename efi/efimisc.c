@@ -43,6 +43,7 @@ grub_efi_init (void)
   /* First of all, initialize the console so that GRUB can display
      messages.  */
   grub_console_init ();
+  grub_efi_init_time ();
   /* Initialize the memory management system.  */
   grub_efi_mm_init ();
   grub_efidisk_init ();
@@ -59,13 +60,13 @@ grub_efi_fini (void)
 void *
 grub_malloc (grub_size_t size)
 {
-  return grub_efi_allocate_pool (size);
+  return grub_efi_heap_alloc (size);
 }
 
 void
 grub_free (void *p)
 {
-  grub_efi_free_pool (p);
+  grub_efi_heap_free (p);
 }
 
 char *
@@ -247,7 +248,7 @@ grub_utf16_to_utf8 (grub_uint8_t *dest, grub_uint16_t *src,
 int
 getrtsecs (void)
 {
-  return grub_get_rtc() / GRUB_TICKS_PER_SECOND;
+  return grub_get_time_us () / 1000000;
 }
 
 void
@@ -399,7 +400,7 @@ safe_parse_maxulong (char **str_ptr, unsigned long *myulong_ptr)
 int
 currticks (void)
 {
-  return grub_get_rtc ();
+  return grub_get_time_us () * GRUB_TICKS_PER_SECOND / 1000000;
 }
 
 static char *
@@ -55,6 +55,133 @@ static struct allocated_page *allocated_pages = 0;
 #define MIN_HEAP_SIZE	0x100000
 #define MAX_HEAP_SIZE	(16 * 0x100000)
 
+/* The heap is obtained from the firmware in regions of MIN_HEAP_SIZE
+   bytes, up to MAX_HEAP_SIZE in total.  Small allocations are rounded up
+   to a power-of-two size class and recycled through a free list per
+   class; anything larger than the biggest class still goes to the
+   firmware pool.  Every chunk starts with a header recording where it
+   came from, so grub_free can tell the two apart.  */
+#define HEAP_MAX_REGIONS	(MAX_HEAP_SIZE / MIN_HEAP_SIZE)
+#define HEAP_HEADER_SIZE	16
+#define HEAP_MIN_CHUNK_BITS	5
+#define HEAP_NUM_CLASSES	9	/* 32 bytes to 8KB */
+#define HEAP_CLASS_POOL		HEAP_NUM_CLASSES
+#define HEAP_MAGIC		0x48454150	/* "HEAP" */
+
+struct heap_chunk
+{
+  grub_uint32_t magic;
+  grub_uint32_t class;
+};
+
+static char *heap_regions[HEAP_MAX_REGIONS];
+static int heap_num_regions;
+static char *heap_top;
+static char *heap_end;
+static void *heap_free_list[HEAP_NUM_CLASSES];
+
+unsigned long heap_size;
+unsigned long heap_used;
+unsigned long heap_peak;
+unsigned long heap_pool_allocs;
+
+/* Add another region to the heap.  Return zero if the heap may not or
+   cannot grow any more.  */
+static int
+heap_grow (void)
+{
+  char *region;
+
+  if (heap_num_regions == HEAP_MAX_REGIONS)
+    return 0;
+
+  region = grub_efi_allocate_pages (0, BYTES_TO_PAGES (MIN_HEAP_SIZE));
+  if (! region)
+    return 0;
+
+  heap_regions[heap_num_regions++] = region;
+  heap_top = region;
+  heap_end = region + MIN_HEAP_SIZE;
+  heap_size += MIN_HEAP_SIZE;
+  return 1;
+}
+
+void *
+grub_efi_heap_alloc (grub_size_t size)
+{
+  struct heap_chunk *chunk;
+  grub_size_t chunk_size;
+  int class;
+
+  chunk_size = 1 << HEAP_MIN_CHUNK_BITS;
+  for (class = 0; class < HEAP_NUM_CLASSES; class++, chunk_size <<= 1)
+    if (size + HEAP_HEADER_SIZE <= chunk_size)
+      break;
+
+  if (class < HEAP_NUM_CLASSES && heap_num_regions)
+    {
+      chunk = heap_free_list[class];
+      if (chunk)
+	heap_free_list[class] = *(void **) ((char *) chunk + HEAP_HEADER_SIZE);
+      else if ((grub_size_t) (heap_end - heap_top) >= chunk_size
+	       || heap_grow ())
+	{
+	  chunk = (struct heap_chunk *) heap_top;
+	  heap_top += chunk_size;
+	}
+
+      if (chunk)
+	{
+	  heap_used += chunk_size;
+	  if (heap_used > heap_peak)
+	    heap_peak = heap_used;
+	  goto found;
+	}
+    }
+
+  chunk = grub_efi_allocate_pool (size + HEAP_HEADER_SIZE);
+  if (! chunk)
+    return NULL;
+  heap_pool_allocs++;
+  class = HEAP_CLASS_POOL;
+
+ found:
+  chunk->magic = HEAP_MAGIC;
+  chunk->class = class;
+  return (char *) chunk + HEAP_HEADER_SIZE;
+}
+
+void
+grub_efi_heap_free (void *p)
+{
+  struct heap_chunk *chunk;
+
+  if (! p)
+    return;
+
+  chunk = (struct heap_chunk *) ((char *) p - HEAP_HEADER_SIZE);
+  if (chunk->magic != HEAP_MAGIC)
+    {
+      grub_printf ("grub_free: bad pointer %p\n", p);
+      return;
+    }
+
+  if (chunk->class == HEAP_CLASS_POOL)
+    {
+      chunk->magic = 0;
+      grub_efi_free_pool (chunk);
+      return;
+    }
+
+  /* The regions are gone after grub_efi_mm_fini.  */
+  if (! heap_num_regions)
+    return;
+
+  heap_used -= (grub_size_t) 1 << (chunk->class + HEAP_MIN_CHUNK_BITS);
+  *(void **) p = heap_free_list[chunk->class];
+  heap_free_list[chunk->class] = chunk;
+}
+
 
 void *
 grub_efi_allocate_pool (grub_efi_uintn_t size)
@@ -119,9 +246,11 @@ grub_efi_allocate_anypages(grub_efi_uintn_t pages)
 
 }
 
-/* Allocate pages. Return the pointer to the first of allocated pages.  */
+/* Allocate pages below MAX_ADDRESS. Return the pointer to the first of
+   allocated pages.  */
 static void *
 grub_efi_allocate_pages_real (grub_efi_physical_address_t address,
+			      grub_efi_physical_address_t max_address,
 			      grub_efi_uintn_t pages,
 			      grub_efi_memory_type_t memtype)
 {
@@ -129,15 +258,13 @@ grub_efi_allocate_pages_real (grub_efi_physical_address_t address,
   grub_efi_status_t status;
   grub_efi_boot_services_t *b;
 
-  /* Limit the memory access to less than 2GB to avoid 64bit
-   * compatible problem of grub  */
-  if (address > 0x7fffffff)
+  if (address > max_address)
     return 0;
 
   if (address == 0)
     {
       type = GRUB_EFI_ALLOCATE_MAX_ADDRESS;
-      address = 0x7fffffff;
+      address = max_address;
     }
   else
     type = GRUB_EFI_ALLOCATE_ADDRESS;
@@ -161,7 +288,7 @@ grub_efi_allocate_pages_real (grub_efi_physical_address_t address,
     {
       /* Uggh, the address 0 was allocated... This is too annoying,
 	 so reallocate another one.  */
-      address = 0x7fffffff;
+      address = max_address;
       status = Call_Service_4 (b->allocate_pages,
 				type, GRUB_EFI_LOADER_DATA, pages, &address);
       grub_efi_free_pages (0, pages);
@@ -197,7 +324,22 @@ grub_efi_allocate_pages (grub_efi_physical_address_t address,
 			 grub_efi_uintn_t pages)
 
 {
-  return grub_efi_allocate_pages_real(address, pages, GRUB_EFI_LOADER_DATA);
+  /* Limit the memory access to less than 2GB to avoid 64bit
+   * compatible problem of grub  */
+  return grub_efi_allocate_pages_real(address, GRUB_EFI_LOW_MAX_ADDRESS,
+				      pages, GRUB_EFI_LOADER_DATA);
+}
+
+/* Like grub_efi_allocate_pages, but for data which GRUB only reads into
+   and hands over, such as a kernel or an initrd, and which may therefore
+   lie anywhere up to MAX_ADDRESS.  */
+void *
+grub_efi_allocate_pages_max (grub_efi_physical_address_t address,
+			     grub_efi_physical_address_t max_address,
+			     grub_efi_uintn_t pages)
+{
+  return grub_efi_allocate_pages_real(address, max_address, pages,
+				      GRUB_EFI_LOADER_DATA);
 }
 
 void *
@@ -205,8 +347,8 @@ grub_efi_allocate_runtime_pages (grub_efi_physical_address_t address,
 				 grub_efi_uintn_t pages)
 
 {
-  return grub_efi_allocate_pages_real(address, pages,
-				      GRUB_EFI_RUNTIME_SERVICES_DATA);
+  return grub_efi_allocate_pages_real(address, GRUB_EFI_LOW_MAX_ADDRESS,
+				      pages, GRUB_EFI_RUNTIME_SERVICES_DATA);
 }
 /* Free pages starting from ADDRESS.  */
 void
@@ -514,12 +656,20 @@ grub_efi_mm_init (void)
 
   grub_memset (allocated_pages, 0, ALLOCATED_PAGES_SIZE);
 
+  if (! heap_grow ())
+    grub_printf ("cannot allocate the heap\n");
+
   update_e820_map (grub_e820_map, &grub_e820_nr_map);
 }
 
 void
 grub_efi_mm_fini (void)
 {
+  /* The heap regions are among the allocated pages freed below.  */
+  heap_num_regions = 0;
+  heap_top = heap_end = 0;
+  grub_memset (heap_free_list, 0, sizeof (heap_free_list));
+
   if (allocated_pages)
     {
       unsigned i;
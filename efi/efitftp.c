@@ -29,18 +29,123 @@ struct tftp_info tftp_info = {
  * BootpBootFile: X86PC/UNDI/pxelinux/bootx64.efi
  */
 
+/*
+ * The block size asked of the server.  0 selects TFTP_BLKSIZE_DEFAULT,
+ * which fills a standard 1500 byte Ethernet frame; PXE BaseCode gives us
+ * no way to learn the path MTU.
+ */
+int tftp_blksize = 0;
+
+/* Set once the server or the firmware has refused a large block size. */
+static int tftp_blksize_refused = 0;
+
+static char *tftp_full_path(char *Filename)
+{
+	char *FullPath;
+
+	if (tftp_info.BasePath) {
+		int PathSize = 0;
+		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
+		FullPath = grub_malloc(PathSize);
+		if (FullPath)
+			grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath,
+				     Filename);
+	} else {
+		FullPath = grub_malloc(strlen(Filename) + 1);
+		if (FullPath)
+			strcpy(FullPath, Filename);
+	}
+	return FullPath;
+}
+
+/* TFTP error codes (RFC 1350) which do not depend on the block size. */
+#define TFTP_ERRCODE_NOT_FOUND	1
+#define TFTP_ERRCODE_ACCESS	2
+
+/*
+ * Return non-zero if the failure RC of an Mtftp operation may come from
+ * a refused blksize option.  A missing or forbidden file is not worth
+ * asking for again with smaller blocks.
+ */
+static int tftp_blksize_suspect(grub_efi_status_t rc)
+{
+	EFI_PXE_BASE_CODE_MODE *Mode = tftp_info.Pxe->Mode;
+
+	switch (rc) {
+	case GRUB_EFI_TFTP_ERROR:
+		if (Mode->TftpErrorReceived &&
+		    (Mode->TftpError.ErrorCode == TFTP_ERRCODE_NOT_FOUND ||
+		     Mode->TftpError.ErrorCode == TFTP_ERRCODE_ACCESS))
+			return 0;
+		return 1;
+	case GRUB_EFI_PROTOCOL_ERROR:
+	case GRUB_EFI_INVALID_PARAMETER:
+	case GRUB_EFI_UNSUPPORTED:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Run one Mtftp operation, asking for a large block size first.  The
+ * blksize option (RFC 2348) is simply ignored by servers that do not know
+ * it, but some firmware fails the whole transfer when the value is above
+ * what it supports, or when the server answers with an option error.  In
+ * that case retry with the classic 512 byte blocks and stick to them.
+ */
+static grub_efi_status_t tftp_mtftp(
+	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode,
+	char *Buffer,
+	grub_efi_uint64_t *BufferSize,
+	char *FullPath)
+{
+	grub_efi_boolean_t Overwrite = 0;
+	grub_efi_boolean_t DontUseBuffer = 0;
+	grub_efi_uint64_t Size = *BufferSize;
+	grub_efi_uintn_t BlockSize;
+	grub_efi_status_t rc;
+
+	if (!FullPath)
+		return GRUB_EFI_OUT_OF_RESOURCES;
+
+	BlockSize = tftp_blksize ? tftp_blksize : TFTP_BLKSIZE_DEFAULT;
+	if (tftp_blksize_refused)
+		BlockSize = TFTP_BLKSIZE_MIN;
+
+	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
+		Buffer, Overwrite, &Size, &BlockSize, tftp_info.ServerIp,
+		FullPath, NULL, DontUseBuffer);
+	if (tftp_blksize_suspect(rc) && BlockSize > TFTP_BLKSIZE_MIN) {
+		grub_efi_status_t rc2;
+
+		Size = *BufferSize;
+		BlockSize = TFTP_BLKSIZE_MIN;
+		rc2 = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe,
+			OpCode, Buffer, Overwrite, &Size, &BlockSize,
+			tftp_info.ServerIp, FullPath, NULL, DontUseBuffer);
+		if (rc2 == GRUB_EFI_SUCCESS || rc2 == GRUB_EFI_BUFFER_TOO_SMALL)
+			tftp_blksize_refused = 1;
+		rc = rc2;
+	}
+	*BufferSize = Size;
+	return rc;
+}
+
+void tftp_set_blksize(int BlockSize)
+{
+	tftp_blksize = BlockSize;
+	tftp_blksize_refused = 0;
+}
+
 static grub_efi_status_t tftp_get_file_size_defective_buffer_fallback(
 	char *Filename,
 	grub_efi_uintn_t *Size)
 {
-	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_READ_FILE;
 	char *Buffer = NULL;
-	grub_efi_boolean_t Overwrite = 0;
-	grub_efi_boolean_t DontUseBuffer = 0;
 	grub_efi_uint64_t BufferSize = 4096;
-	grub_efi_uintn_t BlockSize = 512;
 	grub_efi_status_t rc = GRUB_EFI_BUFFER_TOO_SMALL;
-	char *FullPath = NULL;
+	char *FullPath = tftp_full_path(Filename);
 
 	while (rc == GRUB_EFI_BUFFER_TOO_SMALL) {
 		char *NewBuffer;
@@ -51,25 +156,14 @@ static grub_efi_status_t tftp_get_file_size_defective_buffer_fallback(
 		}
 		BufferSize *= 2;
 		NewBuffer = grub_malloc(BufferSize);
-		if (!NewBuffer)
-			return GRUB_EFI_OUT_OF_RESOURCES;
-		Buffer = NewBuffer;
-
-		if (tftp_info.BasePath) {
-			int PathSize = 0;
-			PathSize = strlen(tftp_info.BasePath) + 2 +
-				   strlen(Filename);
-			FullPath = grub_malloc(PathSize);
-			grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath,
-				     Filename);
-		} else {
-			FullPath = grub_malloc(strlen(Filename));
-			strcpy(FullPath, Filename);
+		if (!NewBuffer) {
+			rc = GRUB_EFI_OUT_OF_RESOURCES;
+			break;
 		}
+		Buffer = NewBuffer;
 
-		rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe,
-			OpCode, Buffer, Overwrite, &BufferSize, &BlockSize,
-			tftp_info.ServerIp, FullPath, NULL, DontUseBuffer);
+		rc = tftp_mtftp(EFI_PXE_BASE_CODE_TFTP_READ_FILE, Buffer,
+				&BufferSize, FullPath);
 		if (rc == GRUB_EFI_SUCCESS || rc == GRUB_EFI_BUFFER_TOO_SMALL)
 			*Size = BufferSize;
 	}
@@ -82,31 +176,16 @@ grub_efi_status_t tftp_get_file_size(
 	char *Filename,
 	grub_efi_uintn_t *Size)
 {
-	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_GET_FILE_SIZE;
 	char Buffer[8192];
-	grub_efi_boolean_t Overwrite = 0;
-	grub_efi_boolean_t DontUseBuffer = 0;
 	grub_efi_uint64_t BufferSize = 8192;
-	grub_efi_uintn_t BlockSize = 512;
 	grub_efi_status_t rc;
-	char *FullPath = NULL;
+	char *FullPath = tftp_full_path(Filename);
 
-	if (tftp_info.BasePath) {
-		int PathSize = 0;
-		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
-		FullPath = grub_malloc(PathSize);
-		grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath, Filename);
-	} else {
-		FullPath = grub_malloc(strlen(Filename));
-		strcpy(FullPath, Filename);
-	}
-
-	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
-		Buffer, Overwrite, &BufferSize, &BlockSize, tftp_info.ServerIp,
-		FullPath, NULL, DontUseBuffer);
+	rc = tftp_mtftp(EFI_PXE_BASE_CODE_TFTP_GET_FILE_SIZE, Buffer,
+			&BufferSize, FullPath);
 	if (rc == GRUB_EFI_BUFFER_TOO_SMALL)
 		rc = tftp_get_file_size_defective_buffer_fallback(Filename, Size);
-	if (rc == GRUB_EFI_SUCCESS)
+	else if (rc == GRUB_EFI_SUCCESS)
 		*Size = BufferSize;
 	grub_free(FullPath);
 	return rc;
@@ -117,26 +196,11 @@ static grub_efi_status_t tftp_read_file(
 	char *Buffer,
 	grub_efi_uint64_t BufferSize)
 {
-	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_READ_FILE;
-	grub_efi_boolean_t Overwrite = 0;
-	grub_efi_boolean_t DontUseBuffer = 0;
-	grub_efi_uintn_t BlockSize = 512;
 	grub_efi_status_t rc;
-	char *FullPath = NULL;
+	char *FullPath = tftp_full_path(Filename);
 
-	if (tftp_info.BasePath) {
-		int PathSize = 0;
-		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
-		FullPath = grub_malloc(PathSize);
-		grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath, Filename);
-	} else {
-		FullPath = grub_malloc(strlen(Filename));
-		strcpy(FullPath, Filename);
-	}
-
-	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
-		Buffer, Overwrite, &BufferSize, &BlockSize, tftp_info.ServerIp,
-		FullPath, NULL, DontUseBuffer);
+	rc = tftp_mtftp(EFI_PXE_BASE_CODE_TFTP_READ_FILE, Buffer,
+			&BufferSize, FullPath);
 	grub_free(FullPath);
 	return rc;
 }
@@ -153,23 +217,51 @@ efi_tftp_mount (void)
 int
 efi_tftp_read (char *addr, int size)
 {
-	int rc;
+	grub_efi_status_t rc;
 
 	if (tftp_info.LastPath == NULL) {
 		grub_printf(" = 0 (no path known)\n");
 		return 0;
 	}
-	if (tftp_info.Buffer == NULL) {
-		grub_printf(" = 0 (no file open)\n");
-		return 0;
-	}
 	if (filemax == -1) {
 		grub_printf(" = 0 (file not found)\n");
 		return 0;
 	}
-	if (filepos == 0) {
+
+	if (tftp_info.Buffer == NULL) {
+		/*
+		 * The whole file in one go: transfer it straight into the
+		 * caller's buffer instead of staging it in our own.
+		 */
+		if (filepos == 0 && size == filemax) {
+			rc = tftp_read_file(tftp_info.LastPath, addr, filemax);
+			if (rc != GRUB_EFI_SUCCESS) {
+				errnum = ERR_READ;
+				return 0;
+			}
+			filepos += size;
+			return size;
+		}
+
+		/*
+		 * Anything else, header probes included, downloads the
+		 * file once and keeps it until close: Mtftp cannot fetch
+		 * part of a file, so a probe of the start costs as much
+		 * as the whole, and the callers go on to read the rest.
+		 */
+		tftp_info.Buffer = grub_malloc(filemax);
+		if (tftp_info.Buffer == NULL) {
+			errnum = ERR_WONT_FIT;
+			return 0;
+		}
 		rc = tftp_read_file(tftp_info.LastPath, tftp_info.Buffer,
 				    filemax);
+		if (rc != GRUB_EFI_SUCCESS) {
+			grub_free(tftp_info.Buffer);
+			tftp_info.Buffer = NULL;
+			errnum = ERR_READ;
+			return 0;
+		}
 	}
 
 	grub_memmove(addr, tftp_info.Buffer+filepos, size);
@@ -200,19 +292,18 @@ efi_tftp_dir (char *dirname)
 		return 1;
 #endif
 
-	filemax = -1;
+	efi_tftp_close();
 
 	rc = tftp_get_file_size(name, &size);
 	if (rc == GRUB_EFI_SUCCESS) {
-		tftp_info.LastPath = grub_malloc(strlen(name) + 1);
-		sprintf(tftp_info.LastPath, "%s", name);
+		tftp_info.LastPath = name;
 		filemax = size;
 		filepos = 0;
 
-		tftp_info.Buffer = grub_malloc(filemax);
-
+		/* The data itself is fetched by the first efi_tftp_read. */
 		return 1;
 	}
+	grub_free(name);
 	return 0;
 }
 
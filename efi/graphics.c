@@ -71,6 +71,9 @@ struct graphics {
     color_state color_state;
 
     char splashpath[64];
+    /* the root a relative splashpath was read from */
+    unsigned long splashdrive;
+    unsigned long splashpartition;
     struct xpm *splashimage;
 
     unsigned short *text;
@@ -176,6 +179,7 @@ grub_efi_setup_gfx_pci(grub_efi_handle_t handle)
 void
 graphics_set_kernel_params(struct linux_kernel_params *params)
 {
+    grub_console_flush ();
     params->video_cursor_x = grub_efi_system_table->con_out->mode->cursor_column;
     params->video_cursor_y = grub_efi_system_table->con_out->mode->cursor_row;
     params->video_page = 0; /* ??? */
@@ -287,6 +291,23 @@ graphics_set_splash_helper(void)
 {
     if (backend) {
         struct xpm *xpm = NULL;
+        unsigned long drive = 0, partition = 0;
+
+        /* A path without a device is read from the current root. */
+        if (splashpath[0] != '(') {
+            drive = saved_drive;
+            partition = saved_partition;
+        }
+
+        /* The image is already decoded; re-parsing it would only slow
+         * down the menu. */
+        if (backend->graphics->splashimage && splashpath[0] &&
+                !grub_strcmp(backend->graphics->splashpath, splashpath) &&
+                backend->graphics->splashdrive == drive &&
+                backend->graphics->splashpartition == partition) {
+            backend->reset_screen_geometry(backend);
+            return;
+        }
 
         if (backend->graphics->splashimage)
             xpm_free(backend->graphics->splashimage);
@@ -297,6 +318,8 @@ graphics_set_splash_helper(void)
         if (xpm) {
             backend->graphics->splashimage = xpm;
 	    grub_strcpy(backend->graphics->splashpath, splashpath);
+            backend->graphics->splashdrive = drive;
+            backend->graphics->splashpartition = partition;
         } else {
             backend->graphics->splashimage = NULL;
             backend->graphics->splashpath[0] = '\0';
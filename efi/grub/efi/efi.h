@@ -24,6 +24,10 @@
 #include <grub/types.h>
 #include <grub/efi/api.h>
 
+/* The highest address of the pages GRUB allocates for itself.  Some of
+   its code keeps addresses in 32 bits.  */
+#define GRUB_EFI_LOW_MAX_ADDRESS	0x7fffffff
+
 /* Functions.  */
 grub_efi_status_t
 grub_efi_locate_device_path (grub_efi_guid_t *protocol,
@@ -50,8 +54,13 @@ void grub_efi_stall (grub_efi_uintn_t microseconds);
 void *grub_efi_allocate_pool (grub_efi_uintn_t size);
 void grub_efi_free_pool (void *buffer);
 void *grub_efi_allocate_anypages (grub_efi_uintn_t pages);
+void *grub_efi_heap_alloc (grub_size_t size);
+void grub_efi_heap_free (void *p);
 void *grub_efi_allocate_pages (grub_efi_physical_address_t address,
 			       grub_efi_uintn_t pages);
+void *grub_efi_allocate_pages_max (grub_efi_physical_address_t address,
+				   grub_efi_physical_address_t max_address,
+				   grub_efi_uintn_t pages);
 void *grub_efi_allocate_runtime_pages (grub_efi_physical_address_t address,
 				       grub_efi_uintn_t pages);
 void
@@ -32,6 +32,8 @@ void e820_map_from_efi_map (struct e820_entry *e820_map,
 void grub_console_init (void);
 /* Finish the console system.  */
 void grub_console_fini (void);
+/* Write out any console output that is still buffered.  */
+void grub_console_flush (void);
 
 void grub_efidisk_init (void);
 void grub_efidisk_fini (void);
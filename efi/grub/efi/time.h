@@ -28,4 +28,10 @@
 /* Return the real time in ticks.  */
 grub_uint32_t grub_get_rtc (void);
 
+/* Calibrate the monotonic clock.  */
+void grub_efi_init_time (void);
+
+/* Return the microseconds since grub_efi_init_time.  */
+grub_uint64_t grub_get_time_us (void);
+
 #endif /* ! GRUB_EFI_TIME_HEADER */
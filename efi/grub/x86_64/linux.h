@@ -45,6 +45,10 @@
 #define GRUB_LINUX_SETUP_MOVE_SIZE	0x9100
 #define GRUB_LINUX_CL_MAGIC		0xA33F
 
+/* The bits of xloadflags.  */
+#define GRUB_LINUX_XLF_KERNEL_64		(1 << 0)
+#define GRUB_LINUX_XLF_CAN_BE_LOADED_ABOVE_4G	(1 << 1)
+
 #if 0 
 #define GRUB_LINUX_EFI_SIGNATURE_X64	\
   ('4' << 24 | '6' << 16 | 'L' << 8 | 'E')
@@ -86,7 +90,7 @@ struct grub_linux_kernel_header
   grub_uint32_t kernel_alignment;
   grub_uint8_t relocatable_kernel;
   grub_uint8_t min_alignment;
-  grub_uint8_t pad2[2];
+  grub_uint16_t xloadflags;	/* 64-bit capabilities, since 2.12 */
   grub_uint32_t cmdline_size;
   grub_uint32_t hardware_subarch;
   grub_uint64_t hardware_subarch_data;
@@ -169,7 +173,13 @@ struct linux_kernel_params
   grub_uint8_t hd1_drive_info[0x10];	/* 90 */
   grub_uint16_t rom_config_len;	/* a0 */
 
-  grub_uint8_t padding6[0x1b8 - 0xa2];
+  grub_uint8_t padding6[0xc0 - 0xa2];
+
+  grub_uint32_t ext_ramdisk_image;	/* c0 */
+  grub_uint32_t ext_ramdisk_size;	/* c4 */
+  grub_uint32_t ext_cmd_line_ptr;	/* c8 */
+
+  grub_uint8_t padding6_1[0x1b8 - 0xcc];
 
   union {
     struct {
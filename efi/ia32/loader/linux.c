@@ -44,6 +44,9 @@
 #define SECTOR_BITS 9
 #endif /* defined(SECTOR_BITS) */
 
+/* The most initrd images that are loaded together.  */
+#define LINUX_MAX_INITRDS 16
+
 static unsigned long linux_mem_size;
 static int loaded;
 static void *real_mode_mem;
@@ -52,6 +55,8 @@ static void *initrd_mem;
 static grub_efi_uintn_t real_mode_pages;
 static grub_efi_uintn_t prot_mode_pages;
 static grub_efi_uintn_t initrd_pages;
+/* The size of the command line buffer, as far as the kernel accepts.  */
+static int linux_cmdline_size;
 static grub_efi_guid_t graphics_output_guid = GRUB_EFI_GRAPHICS_OUTPUT_GUID;
 
 static inline grub_size_t
@@ -226,6 +231,8 @@ big_linux_boot (void)
 
   grub_dprintf(__func__,"got to ExitBootServices...\n");
 
+  bootstat_begin (BOOTSTAT_EXIT_BOOT_SERVICES);
+
 get_mem_map:
   if (grub_efi_get_memory_map (&map_key, &desc_size, &desc_version) <= 0)
     grub_fatal ("cannot get memory map");
@@ -249,6 +256,10 @@ get_mem_map:
     }
 
   /* Note that no boot services are available from here.  */
+  bootstat_end (BOOTSTAT_EXIT_BOOT_SERVICES, 0);
+  if (bootstat_export)
+    bootstat_append_cmdline ((char *) real_mode_mem + 0x1000,
+			     linux_cmdline_size);
 
   /* Pass e820 memmap. */
   e820_map_from_efi_map ((struct e820_entry *) params->e820_map, &e820_nr_map,
@@ -390,7 +401,13 @@ grub_load_linux (char *kernel, char *arg)
 
   setup_sects = lh->setup_sects;
 
-  real_size = 0x1000 + grub_strlen(arg);
+  /* Keep room for the boot timeline after the command line.  */
+  real_size = 0x1000 + grub_strlen(arg) + BOOTSTAT_CMDLINE_MAX;
+  linux_cmdline_size = grub_strlen (arg) + 1 + BOOTSTAT_CMDLINE_MAX;
+  /* Older kernels accept 255 characters, and this header does not
+     describe the field giving the limit of newer ones.  */
+  if (linux_cmdline_size > 256)
+    linux_cmdline_size = 256;
   prot_size = grub_file_size () - (setup_sects << SECTOR_BITS) - SECTOR_SIZE;
 
   if (! allocate_pages (real_size, prot_size))
@@ -527,8 +544,10 @@ grub_load_linux (char *kernel, char *arg)
 
   grub_seek ((setup_sects << SECTOR_BITS) + SECTOR_SIZE);
   len = prot_size;
+  bootstat_begin (BOOTSTAT_KERNEL);
   if (grub_read ((char *) GRUB_LINUX_BZIMAGE_ADDR, len) != len)
     grub_printf ("Couldn't read file");
+  bootstat_end (BOOTSTAT_KERNEL, len);
 
   if (errnum == ERR_NONE)
     {
@@ -561,6 +580,10 @@ grub_load_initrd (char *initrd)
   grub_efi_uintn_t desc_size;
   grub_efi_uint32_t desc_version;
   struct linux_kernel_params *params;
+  char *names[LINUX_MAX_INITRDS];
+  grub_ssize_t sizes[LINUX_MAX_INITRDS];
+  int num_initrds, i;
+  char *name, *pos, *dest;
 
   if (initrd == NULL)
     {
@@ -576,10 +599,37 @@ grub_load_initrd (char *initrd)
       goto fail1;
     }
 
-  if (! grub_open (initrd))
-    goto fail1;
+  /* Size all the images first, so that they can be read back to back
+     into one allocation.  Each of them starts at a 4-byte boundary, as
+     Linux expects of concatenated cpio archives.  */
+  size = 0;
+  num_initrds = 0;
+  for (name = strtok_r (initrd, " \t", &pos); name;
+       name = strtok_r (NULL, " \t", &pos))
+    {
+      if (num_initrds == LINUX_MAX_INITRDS)
+	{
+	  errnum = ERR_BAD_ARGUMENT;
+	  grub_printf ("Too many initrds");
+	  goto fail1;
+	}
+
+      if (! grub_open (name))
+	goto fail1;
+      sizes[num_initrds] = grub_file_size ();
+      grub_close ();
+
+      size = ((size + 3) & ~3) + sizes[num_initrds];
+      names[num_initrds++] = name;
+    }
+
+  if (! num_initrds)
+    {
+      errnum = ERR_BAD_FILENAME;
+      grub_printf ("No module specified");
+      goto fail1;
+    }
 
-  size = grub_file_size ();
   initrd_pages = (page_align (size) >> 12);
 
   params = (struct linux_kernel_params *) real_mode_mem;
@@ -640,7 +690,7 @@ grub_load_initrd (char *initrd)
     {
       errnum = ERR_UNRECOGNIZED;
       grub_printf ("no free pages available");
-      goto fail;
+      goto fail1;
     }
 
   initrd_mem = grub_efi_allocate_pages (addr, initrd_pages);
@@ -648,10 +698,28 @@ grub_load_initrd (char *initrd)
     grub_fatal ("cannot allocate pages: %x@%x", (unsigned)initrd_pages,
 		(unsigned)addr);
 
-  if (grub_read (initrd_mem, size) != size)
+  dest = initrd_mem;
+  for (i = 0; i < num_initrds; i++)
     {
-      grub_printf ("Couldn't read file");
-      goto fail;
+      /* Clear the padding after the previous image.  */
+      while ((dest - (char *) initrd_mem) & 3)
+	*dest++ = 0;
+
+      if (! grub_open (names[i]))
+	goto fail1;
+
+      bootstat_begin (BOOTSTAT_INITRD);
+      if (grub_read (dest, sizes[i]) != sizes[i])
+	{
+	  bootstat_end (BOOTSTAT_INITRD, 0);
+	  grub_printf ("Couldn't read file");
+	  grub_close ();
+	  goto fail1;
+	}
+      bootstat_end (BOOTSTAT_INITRD, sizes[i]);
+
+      grub_close ();
+      dest += sizes[i];
     }
 
   grub_printf ("   [Initrd, addr=0x%x, size=0x%x]\n", (unsigned int) addr,
@@ -660,8 +728,6 @@ grub_load_initrd (char *initrd)
   params->hdr.ramdisk_image = addr;
   params->hdr.ramdisk_size = size;
 
- fail:
-  grub_close ();
  fail1:
   return !errnum;
 }
@@ -44,6 +44,9 @@
 #define SECTOR_BITS 9
 #endif /* defined(SECTOR_BITS) */
 
+/* The most initrd images that are loaded together.  */
+#define LINUX_MAX_INITRDS 16
+
 static unsigned long linux_mem_size;
 static int loaded;
 static void *real_mode_mem;
@@ -53,6 +56,8 @@ static void *initrd_mem;
 static grub_efi_uintn_t real_mode_pages;
 static grub_efi_uintn_t prot_mode_pages;
 static grub_efi_uintn_t initrd_pages;
+/* The size of the command line buffer, as far as the kernel accepts.  */
+static int linux_cmdline_size;
 static grub_efi_guid_t graphics_output_guid = GRUB_EFI_GRAPHICS_OUTPUT_GUID;
 
 static inline grub_size_t
@@ -295,6 +300,8 @@ big_linux_boot (void)
 
   grub_efi_disable_network();
 
+  bootstat_begin (BOOTSTAT_EXIT_BOOT_SERVICES);
+
 get_mem_map:
   if (grub_efi_get_memory_map (&map_key, &desc_size, &desc_version) <= 0)
     grub_fatal ("cannot get memory map");
@@ -318,6 +325,10 @@ get_mem_map:
     }
 
   /* Note that no boot services are available from here.  */
+  bootstat_end (BOOTSTAT_EXIT_BOOT_SERVICES, 0);
+  if (bootstat_export)
+    bootstat_append_cmdline ((char *) real_mode_mem + 0x1000,
+			     linux_cmdline_size);
 
   /* Pass e820 memmap. */
   e820_map_from_efi_map ((struct e820_entry *) params->e820_map, &e820_nr_map,
@@ -440,7 +451,17 @@ grub_load_linux (char *kernel, char *arg)
 
   setup_sects = lh->setup_sects;
 
-  real_size = 0x1000 + grub_strlen(arg);
+  /* Keep room for the boot timeline after the command line.  */
+  real_size = 0x1000 + grub_strlen(arg) + BOOTSTAT_CMDLINE_MAX;
+  linux_cmdline_size = grub_strlen (arg) + 1 + BOOTSTAT_CMDLINE_MAX;
+  /* Kernels before the boot protocol 2.06 accept 255 characters.  */
+  if (grub_le_to_cpu16 (lh->version) < 0x0206)
+    {
+      if (linux_cmdline_size > 256)
+	linux_cmdline_size = 256;
+    }
+  else if (linux_cmdline_size > (int) lh->cmdline_size + 1)
+    linux_cmdline_size = lh->cmdline_size + 1;
   prot_size = grub_file_size () - (setup_sects << SECTOR_BITS) - SECTOR_SIZE;
   prot_kernel_size = prot_size;
 
@@ -574,8 +595,10 @@ grub_load_linux (char *kernel, char *arg)
 
   grub_seek ((setup_sects << SECTOR_BITS) + SECTOR_SIZE);
   len = prot_size;
+  bootstat_begin (BOOTSTAT_KERNEL);
   if (grub_read ((char *)prot_mode_mem, len) != len)
     grub_printf ("Couldn't read file");
+  bootstat_end (BOOTSTAT_KERNEL, len);
 
   if (lh->version >= 0x205) {
     for (align = lh->min_alignment; align < 32; align++) {
@@ -628,7 +651,13 @@ grub_load_linux (char *kernel, char *arg)
 	      (tdesc.physical_start + (tdesc.num_pages << 12)))
 	    continue;
 
-	  kernel_base = (grub_uint64_t)grub_efi_allocate_pages(addr, kernel_pages);
+	  /* The kernel is entered at code32_start, which has 32 bits.  */
+	  if (addr + kernel_length > 0x100000000ULL)
+	    continue;
+
+	  kernel_base = (grub_uint64_t)grub_efi_allocate_pages_max(addr,
+								  0xffffffffULL,
+								  kernel_pages);
 
 	  if (kernel_base) {
 	    lh->kernel_alignment = 1 << align;
@@ -677,6 +706,10 @@ grub_load_initrd (char *initrd)
   grub_efi_memory_descriptor_t tdesc;
   grub_efi_uintn_t desc_size;
   struct linux_kernel_params *params;
+  char *names[LINUX_MAX_INITRDS];
+  grub_ssize_t sizes[LINUX_MAX_INITRDS];
+  int num_initrds, i;
+  char *name, *pos, *dest;
 
   if (initrd == NULL)
     {
@@ -692,16 +725,48 @@ grub_load_initrd (char *initrd)
       goto fail1;
     }
 
-  if (! grub_open (initrd))
-    goto fail1;
+  /* Size all the images first, so that they can be read back to back
+     into one allocation.  Each of them starts at a 4-byte boundary, as
+     Linux expects of concatenated cpio archives.  */
+  size = 0;
+  num_initrds = 0;
+  for (name = strtok_r (initrd, " \t", &pos); name;
+       name = strtok_r (NULL, " \t", &pos))
+    {
+      if (num_initrds == LINUX_MAX_INITRDS)
+	{
+	  errnum = ERR_BAD_ARGUMENT;
+	  grub_printf ("Too many initrds");
+	  goto fail1;
+	}
+
+      if (! grub_open (name))
+	goto fail1;
+      sizes[num_initrds] = grub_file_size ();
+      grub_close ();
+
+      size = ((size + 3) & ~3) + sizes[num_initrds];
+      names[num_initrds++] = name;
+    }
+
+  if (! num_initrds)
+    {
+      errnum = ERR_BAD_FILENAME;
+      grub_printf ("No module specified");
+      goto fail1;
+    }
 
-  size = grub_file_size ();
   initrd_pages = (page_align (size) >> 12);
 
   params = (struct linux_kernel_params *) real_mode_mem;
   grub_dprintf(__func__, "initrd_pages: %lu\n", initrd_pages);
 
   addr_max = grub_cpu_to_le32 (params->hdr.initrd_addr_max);
+  /* The kernel may be able to take the initrd anywhere.  */
+  if (grub_le_to_cpu16 (params->hdr.version) >= 0x020c
+      && (grub_le_to_cpu16 (params->hdr.xloadflags)
+	  & GRUB_LINUX_XLF_CAN_BE_LOADED_ABOVE_4G))
+    addr_max = ~(grub_addr_t) 0;
   if (linux_mem_size != 0 && linux_mem_size < addr_max)
     addr_max = linux_mem_size;
   addr_max &= ~((1 << 12)-1);
@@ -740,7 +805,7 @@ grub_load_initrd (char *initrd)
 	  if (physical_end > addr_max)
 	    physical_end = addr_max;
 
-	  if (physical_end <= 0x7fffffffUL && physical_end > addr)
+	  if (physical_end > addr)
 	    addr = physical_end - page_align (size);
 	}
     }
@@ -749,29 +814,47 @@ grub_load_initrd (char *initrd)
     {
       errnum = ERR_UNRECOGNIZED;
       grub_printf ("no free pages available");
-      goto fail;
+      goto fail1;
     }
 
-  initrd_mem = grub_efi_allocate_pages (addr, initrd_pages);
+  initrd_mem = grub_efi_allocate_pages_max (addr, addr_max, initrd_pages);
   if (! initrd_mem)
-    grub_fatal ("cannot allocate pages: %x@%x", (unsigned)initrd_pages,
-		(unsigned)addr);
+    grub_fatal ("cannot allocate pages: %lx@%lx",
+		(unsigned long) initrd_pages, (unsigned long) addr);
 
-  if (grub_read (initrd_mem, size) != size)
+  dest = initrd_mem;
+  for (i = 0; i < num_initrds; i++)
     {
-      grub_printf ("Couldn't read file");
-      goto fail;
+      /* Clear the padding after the previous image.  */
+      while ((dest - (char *) initrd_mem) & 3)
+	*dest++ = 0;
+
+      if (! grub_open (names[i]))
+	goto fail1;
+
+      bootstat_begin (BOOTSTAT_INITRD);
+      if (grub_read (dest, sizes[i]) != sizes[i])
+	{
+	  bootstat_end (BOOTSTAT_INITRD, 0);
+	  grub_printf ("Couldn't read file");
+	  grub_close ();
+	  goto fail1;
+	}
+      bootstat_end (BOOTSTAT_INITRD, sizes[i]);
+
+      grub_close ();
+      dest += sizes[i];
     }
 
-  grub_printf ("   [Initrd, addr=0x%x, size=0x%x]\n", (unsigned int) addr,
-	       (unsigned int) size);
+  grub_printf ("   [Initrd, addr=0x%lx, size=0x%lx]\n", (unsigned long) addr,
+	       (unsigned long) size);
 
   params->hdr.ramdisk_image = addr;
   params->hdr.ramdisk_size = size;
+  params->ext_ramdisk_image = (grub_uint64_t) addr >> 32;
+  params->ext_ramdisk_size = (grub_uint64_t) size >> 32;
   params->hdr.root_dev = 0x0100; /* XXX */
 
- fail:
-  grub_close ();
  fail1:
   return !errnum;
 }
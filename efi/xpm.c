@@ -59,6 +59,32 @@ hex_to_int(int v)
     return (v - '0');
 }
 
+/* The whole file is read into memory once and parsed from there; going
+ * through grub_read (and the decompressor) for every byte is slow. */
+struct xpm_reader {
+    char *data;
+    int pos;
+    int len;
+};
+
+static int
+xpm_read(struct xpm_reader *rd, char *buf, int len)
+{
+    if (len > rd->len - rd->pos)
+        len = rd->len - rd->pos;
+    grub_memmove(buf, rd->data + rd->pos, len);
+    rd->pos += len;
+    return len;
+}
+
+static struct xpm *
+xpm_fail(struct xpm *xpm, struct xpm_reader *rd)
+{
+    grub_free(rd->data);
+    grub_free(xpm);
+    return NULL;
+}
+
 struct xpm *
 xpm_open(char *path)
 {
@@ -67,7 +93,9 @@ xpm_open(char *path)
     int pos = 0;
     unsigned int i, idx, len, x, y;
     unsigned char pal[XPM_MAX_COLORS];
+    unsigned char map[256];
     struct xpm *xpm;
+    struct xpm_reader rd;
 
     xpm = grub_malloc(sizeof (*xpm));
     if (!xpm)
@@ -81,14 +109,22 @@ xpm_open(char *path)
 
     grub_memset(xpm, '\0', sizeof (*xpm));
 
+    rd.pos = 0;
+    rd.len = filemax;
+    rd.data = grub_malloc(filemax);
+    if (!rd.data || grub_read(rd.data, filemax) != filemax) {
+        grub_printf("grub_read() failed\n");
+        grub_close();
+        return xpm_fail(xpm, &rd);
+    }
+    grub_close();
+
     prev = '\n';
     c = 0;
     do {
-        if (grub_read(&c, 1) != 1) {
-            grub_printf("grub_read() failed\n");
-            grub_free(xpm);
-            grub_close();
-            return NULL;
+        if (xpm_read(&rd, &c, 1) != 1) {
+            grub_printf("%s is not an XPM file\n", path);
+            return xpm_fail(xpm, &rd);
         }
         if ((pos == 0 && prev == '\n') || pos > 0) {
             if (c == target[pos])
@@ -100,16 +136,16 @@ xpm_open(char *path)
     } while (target[pos]);
 
     /* parse info */
-    while (grub_read(&c, 1)) {
+    while (xpm_read(&rd, &c, 1)) {
         if (c == '"')
             break;
     }
-    while (grub_read(&c, 1) && (c == ' ' || c == '\t'))
+    while (xpm_read(&rd, &c, 1) && (c == ' ' || c == '\t'))
         ;
 
     i = 0;
     xpm->width = c - '0';
-    while (grub_read(&c, 1)) {
+    while (xpm_read(&rd, &c, 1)) {
         if (c >= '0' && c <= '9')
             xpm->width = xpm->width * 10 + c - '0';
         else
@@ -118,15 +154,13 @@ xpm_open(char *path)
     if (xpm->width > XPM_MAX_WIDTH) {
         grub_printf("xpm->width (%d) was greater than XPM_MAX_WIDTH (%d)\n",
                 xpm->width, XPM_MAX_WIDTH);
-        grub_free(xpm);
-        grub_close();
-        return NULL;
+        return xpm_fail(xpm, &rd);
     }
-    while (grub_read(&c, 1) && (c == ' ' || c == '\t'))
+    while (xpm_read(&rd, &c, 1) && (c == ' ' || c == '\t'))
         ;
 
     xpm->height = c - '0';
-    while (grub_read(&c, 1)) {
+    while (xpm_read(&rd, &c, 1)) {
         if (c >= '0' && c <= '9')
             xpm->height = xpm->height * 10 + c - '0';
         else
@@ -135,16 +169,14 @@ xpm_open(char *path)
     if (xpm->height > XPM_MAX_HEIGHT) {
         grub_printf("xpm->height (%d) was greater than XPM_MAX_HEIGHT (%d)\n",
                 xpm->height, XPM_MAX_HEIGHT);
-        grub_free(xpm);
-        grub_close();
-        return NULL;
+        return xpm_fail(xpm, &rd);
     }
 
-    while (grub_read(&c, 1) && (c == ' ' || c == '\t'))
+    while (xpm_read(&rd, &c, 1) && (c == ' ' || c == '\t'))
         ;
 
     xpm->colors = c - '0';
-    while (grub_read(&c, 1)) {
+    while (xpm_read(&rd, &c, 1)) {
         if (c >= '0' && c <= '9')
             xpm->colors = xpm->colors * 10 + c - '0';
         else
@@ -152,25 +184,25 @@ xpm_open(char *path)
     }
 
     base = 0;
-    while (grub_read(&c, 1) && c != '"')
+    while (xpm_read(&rd, &c, 1) && c != '"')
         ;
 
     /* palette */
     for (i = 0, idx = 1; i < xpm->colors; i++) {
         len = 0;
 
-        while (grub_read(&c, 1) && c != '"')
+        while (xpm_read(&rd, &c, 1) && c != '"')
             ;
-        grub_read(&c, 1);       /* char */
+        xpm_read(&rd, &c, 1);   /* char */
         base = c;
-        grub_read(buf, 4);      /* \t c # */
+        xpm_read(&rd, buf, 4);  /* \t c # */
 
-        while (grub_read(&c, 1) && c != '"') {
+        while (xpm_read(&rd, &c, 1) && c != '"') {
             if (len < sizeof(buf))
                 buf[len++] = c;
         }
 
-        if (len == 6 && idx < xpm->colors) {
+        if (len == 6 && idx < xpm->colors && idx < XPM_MAX_COLORS) {
             unsigned char r, g, b;
             
             r = (hex_to_int(buf[0]) << 4) | hex_to_int(buf[1]);
@@ -185,28 +217,27 @@ xpm_open(char *path)
         }
     }
 
+    /* map each pixel character straight to its palette index; the first
+     * palette entry using a character wins */
+    grub_memset(map, 0, sizeof (map));
+    for (i = idx - 1; i >= 1; i--)
+        map[pal[i]] = i;
+
     /* parse xpm data */
     x = y = 0;
     while (y < xpm->height) {
-        xpm_pixel_t *pixel = NULL;
         while (1) {
-            if (!grub_read(&c, 1)) {
-                grub_printf("%s %s:%d grub_read() failed\n", __FILE__, __func__, __LINE__);
-                grub_free(xpm);
-                grub_close();
-                return NULL;
+            if (!xpm_read(&rd, &c, 1)) {
+                grub_printf("%s %s:%d unexpected end of file\n", __FILE__, __func__, __LINE__);
+                return xpm_fail(xpm, &rd);
             }
             if (c == '"')
                 break;
         }
 
-        while (grub_read(&c, 1) && c != '"') {
-            unsigned char *iaddr = NULL;
-            for (i = 1; i < xpm->colors; i++)
-                if (pal[i] == c) {
-                    idx = i;
-                    break;
-                }
+        while (xpm_read(&rd, &c, 1) && c != '"') {
+            if (map[(unsigned char) c])
+                idx = map[(unsigned char) c];
 
             xpm_set_pixel_idx(xpm, x, y, idx);
            
@@ -217,7 +248,7 @@ xpm_open(char *path)
             }
         }
     }
-    grub_close();
+    grub_free(rd.data);
     return xpm;
 }
 
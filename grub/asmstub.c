@@ -1054,7 +1054,7 @@ hex_dump (void *buf, size_t size)
 
 int
 biosdisk (int subfunc, int drive, struct geometry *geometry,
-	  int sector, int nsec, int segment)
+	  grub_sector_t sector, int nsec, int segment)
 {
   char *buf;
   int fd = geometry->flags;
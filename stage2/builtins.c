@@ -22,6 +22,7 @@
    WITHOUT_LIBC_STUBS here.  */
 #ifdef GRUB_UTIL
 # include <stdio.h>
+# include <sys/time.h>
 #endif
 
 #include <shared.h>
@@ -149,9 +150,9 @@ check_password (char *entered, char* expected, password_t type)
 
 /* Print which sector is read when loading a file.  */
 static void
-disk_read_print_func (int sector, int offset, int length)
+disk_read_print_func (grub_sector_t sector, int offset, int length)
 {
-  grub_printf ("[%d,%d,%d]", sector, offset, length);
+  grub_printf ("[%lld,%d,%d]", (long long) sector, offset, length);
 }
 
 
@@ -175,7 +176,7 @@ disk_read_print_func (int sector, int offset, int length)
  */
    
 static struct {
-	int start_sector;
+	grub_sector_t start_sector;
 	int num_sectors;
 	int num_entries;
 	int last_length;
@@ -189,9 +190,9 @@ static struct {
 /* Collect contiguous blocks into one entry as many as possible,
    and print the blocklist notation on the screen.  */
 static void
-blocklist_read_helper (int sector, int offset, int length)
+blocklist_read_helper (grub_sector_t sector, int offset, int length)
 {
-  int *start_sector = &blocklist_func_context.start_sector;
+  grub_sector_t *start_sector = &blocklist_func_context.start_sector;
   int *num_sectors = &blocklist_func_context.num_sectors;
   int *num_entries = &blocklist_func_context.num_entries;
   int *last_length = &blocklist_func_context.last_length;
@@ -202,33 +203,33 @@ blocklist_read_helper (int sector, int offset, int length)
     if (*start_sector + *num_sectors == sector
       && offset == 0 && *last_length == sector_size)
     {
-      *num_sectors++;
+      (*num_sectors)++;
       *last_length = length;
       return;
     }
     else
     {
       if (*last_length == sector_size)
-        grub_printf ("%s%d+%d", *num_entries ? "," : "",
-          *start_sector - part_start, *num_sectors);
+        grub_printf ("%s%lld+%d", *num_entries ? "," : "",
+          (long long) (*start_sector - part_start), *num_sectors);
       else if (*num_sectors > 1)
-        grub_printf ("%s%d+%d,%d[0-%d]", *num_entries ? "," : "",
-          *start_sector - part_start, *num_sectors-1,
-          *start_sector + *num_sectors-1 - part_start, 
+        grub_printf ("%s%lld+%d,%lld[0-%d]", *num_entries ? "," : "",
+          (long long) (*start_sector - part_start), *num_sectors-1,
+          (long long) (*start_sector + *num_sectors-1 - part_start),
           *last_length);
       else
-        grub_printf ("%s%d[0-%d]", *num_entries ? "," : "",
-          *start_sector - part_start, *last_length);
-      *num_entries++;
+        grub_printf ("%s%lld[0-%d]", *num_entries ? "," : "",
+          (long long) (*start_sector - part_start), *last_length);
+      (*num_entries)++;
       *num_sectors = 0;
     }
   }
 
   if (offset > 0)
   {
-    grub_printf("%s%d[%d-%d]", *num_entries ? "," : "",
-          sector-part_start, offset, offset+length);
-    *num_entries++;
+    grub_printf("%s%lld[%d-%d]", *num_entries ? "," : "",
+          (long long) (sector - part_start), offset, offset+length);
+    (*num_entries)++;
   }
   else
   {
@@ -244,7 +245,7 @@ blocklist_func (char *arg, int flags)
 {
   char *dummy = (char *) RAW_ADDR (0x100000);
 
-  int *start_sector = &blocklist_func_context.start_sector;
+  grub_sector_t *start_sector = &blocklist_func_context.start_sector;
   int *num_sectors = &blocklist_func_context.num_sectors;
   int *num_entries = &blocklist_func_context.num_entries;
 
@@ -273,8 +274,8 @@ blocklist_func (char *arg, int flags)
   /* The last entry may not be printed yet.  Don't check if it is a
    * full sector, since it doesn't matter if we read too much. */
   if (*num_sectors > 0)
-    grub_printf ("%s%d+%d", *num_entries ? "," : "",
-		 *start_sector - part_start, *num_sectors);
+    grub_printf ("%s%lld+%d", *num_entries ? "," : "",
+		 (long long) (*start_sector - part_start), *num_sectors);
 
   grub_printf ("\n");
   
@@ -448,6 +449,30 @@ static struct builtin builtin_bootp =
 };
 #endif /* SUPPORT_NETBOOT */
 
+#ifdef PLATFORM_EFI
+/* bootstat [--kernel] */
+static int
+bootstat_func (char *arg, int flags)
+{
+  if (grub_memcmp (arg, "--kernel", sizeof ("--kernel") - 1) == 0)
+    bootstat_export = 1;
+
+  bootstat_print ();
+  return 0;
+}
+
+static struct builtin builtin_bootstat =
+{
+  "bootstat",
+  bootstat_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "bootstat [--kernel]",
+  "Display the time spent in each phase of booting so far, in"
+  " microseconds. If the option `--kernel' is specified, also pass"
+  " the timeline to Linux as the parameter `grub.bootstat'."
+};
+#endif /* PLATFORM_EFI */
+
 
 /* cat */
 static int
@@ -574,7 +599,7 @@ cmp_func (char *arg, int flags)
   char *addr1, *addr2;
   int i;
   /* The size of the file.  */
-  int size;
+  grub_filepos_t size;
 
   /* Get the filenames from ARG.  */
   file1 = arg;
@@ -612,8 +637,9 @@ cmp_func (char *arg, int flags)
   /* Check if the size of FILE2 is equal to the one of FILE2.  */
   if (size != filemax)
     {
-      grub_printf ("Differ in size: 0x%x [%s], 0x%x [%s]\n",
-		   size, file1, filemax, file2);
+      grub_printf ("Differ in size: 0x%llx [%s], 0x%llx [%s]\n",
+		   (unsigned long long) size, file1,
+		   (unsigned long long) filemax, file2);
       grub_close ();
       return 0;
     }
@@ -999,6 +1025,44 @@ static struct builtin builtin_dhcp =
 };
 #endif /* SUPPORT_NETBOOT */
 
+#ifdef PLATFORM_EFI
+/* diskcache [--flush] [SIZE] */
+static int
+diskcache_func (char *arg, int flags)
+{
+  int size;
+
+  if (grub_memcmp (arg, "--flush", sizeof ("--flush") - 1) == 0)
+    {
+      disk_cache_invalidate ();
+      arg = skip_to (0, arg);
+    }
+
+  if (*arg)
+    {
+      if (! safe_parse_maxint (&arg, &size))
+	return 1;
+
+      disk_cache_resize (size);
+    }
+
+  grub_printf (" Disk cache: %dK, %lu hits, %lu misses\n",
+	       disk_cache_size, disk_cache_hits, disk_cache_misses);
+  return 0;
+}
+
+static struct builtin builtin_diskcache =
+{
+  "diskcache",
+  diskcache_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "diskcache [--flush] [SIZE]",
+  "Display the disk cache statistics. If SIZE is specified, resize the"
+  " cache to SIZE kilobytes; 0 disables it. If the option `--flush' is"
+  " specified, discard all the cached disk blocks."
+};
+#endif /* PLATFORM_EFI */
+
 static int terminal_func (char *arg, int flags);
 
 #ifdef SUPPORT_GRAPHICS
@@ -1212,6 +1276,12 @@ displaymem_func (char *arg, int flags)
 	}
     }
 
+#ifdef PLATFORM_EFI
+  grub_printf (" Heap: %luK used of %luK (peak %luK), %lu pool allocations\n",
+	       heap_used >> 10, heap_size >> 10, heap_peak >> 10,
+	       heap_pool_allocs);
+#endif
+
   return 0;
 }
 
@@ -1511,16 +1581,17 @@ find_func (char *arg, int flags)
   for (drive = 0x80; drive < (0x80 + MAX_HD_NUM); drive++)
     {
       unsigned long part = 0xFFFFFF;
-      unsigned long start, len, offset, ext_offset, gpt_offset;
+      grub_part_sector_t start, len, gpt_offset;
+      unsigned long offset, ext_offset;
       int type, entry, gpt_count, gpt_size;
       int sector_size = get_sector_size(drive);
       char buf[sector_size];
 
       current_drive = drive;
-      while (next_partition (drive, 0xFFFFFF, &part, &type,
-			     &start, &len, &offset, &entry,
-                            &ext_offset, &gpt_offset,
-                            &gpt_count, &gpt_size, buf))
+      while (next_cached_partition (drive, 0xFFFFFF, &part, &type,
+				    &start, &len, &offset, &entry,
+				    &ext_offset, &gpt_offset,
+				    &gpt_count, &gpt_size, buf))
 	{
 	  if (type != PC_SLICE_TYPE_NONE
 	      && ! IS_PC_SLICE_TYPE_BSD (type)
@@ -1738,10 +1809,10 @@ geometry_func (char *arg, int flags)
 #endif
 
   grub_printf ("drive 0x%x: C/H/S = %d/%d/%d, "
-	       "The number of sectors = %d, %s\n",
+	       "The number of sectors = %llu, %s\n",
 	       current_drive,
 	       geom.cylinders, geom.heads, geom.sectors,
-	       geom.total_sectors, msg);
+	       (unsigned long long) geom.total_sectors, msg);
   real_open_partition (1);
 
   return 0;
@@ -2093,7 +2164,7 @@ static struct {
 /* Save the first sector of Stage2 in STAGE2_SECT.  */
 /* Formerly disk_read_savesect_func with local scope inside install_func */
 static void
-install_savesect_helper(int sector, int offset, int length)
+install_savesect_helper(grub_sector_t sector, int offset, int length)
 {
   if (debug)
     printf ("[%d]", sector);
@@ -2110,7 +2181,7 @@ install_savesect_helper(int sector, int offset, int length)
 /* Write SECTOR to INSTALLLIST, and update INSTALLADDR and  INSTALLSECT.  */
 /* Formerly disk_read_blocklist_func with local scope inside install_func */
 static void
-install_blocklist_helper (int sector, int offset, int length)
+install_blocklist_helper (grub_sector_t sector, int offset, int length)
 {
   int *installaddr = &install_func_context.installaddr;
   int *installlist = &install_func_context.installlist;
@@ -2947,6 +3018,125 @@ static struct builtin builtin_md5crypt =
 };
 #endif /* USE_MD5_PASSWORDS */
 
+#ifdef GRUB_UTIL
+/* memspeed */
+static unsigned long long
+memspeed_usecs (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, 0);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/* Print the rate of COUNT rounds over SIZE bytes since START.  */
+static void
+memspeed_report (char *name, unsigned long long start, int count, int size)
+{
+  unsigned long long usecs = memspeed_usecs () - start;
+
+  if (! usecs)
+    usecs = 1;
+  grub_printf ("%s %d MB/s\n", name,
+	       (int) ((unsigned long long) count * size / usecs));
+}
+
+static int
+memspeed_func (char *arg, int flags)
+{
+  char *from = (char *) RAW_ADDR (0x100000);
+  char *to = (char *) RAW_ADDR (0x200000);
+  int size = 0x100000 - 64;
+  int count, i, j, d0, d1, d2;
+  unsigned long long start;
+
+  if (*arg && (! safe_parse_maxint (&arg, &size)
+	       || size <= 0 || size > 0x100000 - 64))
+    {
+      errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
+
+  /* about 256MB a measurement */
+  count = (256 << 20) / size;
+  for (i = 0; i < size + 8; i++)
+    from[i] = i;
+
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    grub_memmove (to, from, size);
+  memspeed_report ("memmove, aligned:    ", start, count, size);
+
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    grub_memmove (to + 1, from, size);
+  memspeed_report ("memmove, unaligned:  ", start, count, size);
+
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    grub_memmove (to + 8, to, size);
+  memspeed_report ("memmove, overlapping:", start, count, size);
+
+  /* the byte moves grub_memmove used to do */
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    asm volatile ("cld\n\t"
+		  "rep\n\t"
+		  "movsb"
+		  : "=&c" (d0), "=&S" (d1), "=&D" (d2)
+		  : "0" (size), "1" (from), "2" (to)
+		  : "memory");
+  memspeed_report ("rep movsb:           ", start, count, size);
+
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    grub_memset (to, i, size);
+  memspeed_report ("memset:              ", start, count, size);
+
+  /* the best a byte loop like the old grub_memset could do */
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    asm volatile ("cld\n\t"
+		  "rep\n\t"
+		  "stosb"
+		  : "=&c" (d0), "=&D" (d1)
+		  : "a" (i), "0" (size), "1" (to)
+		  : "memory");
+  memspeed_report ("rep stosb:           ", start, count, size);
+
+  grub_memmove (to, from, size);
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    if (grub_memcmp (to, from, size))
+      break;
+  memspeed_report ("memcmp:              ", start, count, size);
+
+  /* what grub_memcmp used to do */
+  start = memspeed_usecs ();
+  for (i = 0; i < count; i++)
+    {
+      for (j = 0; j < size; j++)
+	if (((volatile char *) to)[j] != from[j])
+	  break;
+      if (j < size)
+	break;
+    }
+  memspeed_report ("byte compare:        ", start, count, size);
+
+  return 0;
+}
+
+static struct builtin builtin_memspeed =
+{
+  "memspeed",
+  memspeed_func,
+  BUILTIN_CMDLINE,
+  "memspeed [SIZE]",
+  "Time grub_memmove, grub_memset and grub_memcmp over SIZE bytes, and"
+  " the byte-at-a-time code they replaced. SIZE defaults to nearly 1MB."
+};
+#endif /* GRUB_UTIL */
+
 #ifndef PLATFORM_EFI
 
 /* module */
@@ -3187,7 +3377,8 @@ parttype_func (char *arg, int flags)
 {
   int new_type;
   unsigned long part = 0xFFFFFF;
-  unsigned long start, len, offset, ext_offset, gpt_offset;
+  grub_part_sector_t start, len, gpt_offset;
+  unsigned long offset, ext_offset;
   int entry, type, gpt_count, gpt_size;
 
   /* Get the drive and the partition.  */
@@ -4887,7 +5078,7 @@ testload_func (char *arg, int flags)
 	!= *((unsigned char *) RAW_ADDR (0x300000 + i)))
       break;
 
-  grub_printf ("Max is 0x10ac0: i=0x%x, filepos=0x%x\n", i, filepos);
+  grub_printf ("Max is 0x10ac0: i=0x%x, filepos=0x%x\n", i, (int) filepos);
   disk_read_hook = 0;
   grub_close ();
   return 0;
@@ -5041,6 +5232,46 @@ static struct builtin builtin_tftpserver =
 };
 #endif /* SUPPORT_NETBOOT */
 
+#ifdef PLATFORM_EFI
+/* tftpblksize [SIZE] */
+static int
+tftpblksize_func (char *arg, int flags)
+{
+  int size;
+
+  if (*arg)
+    {
+      if (! safe_parse_maxint (&arg, &size))
+	return 1;
+
+      if (size != 0 && (size < TFTP_BLKSIZE_MIN || size > TFTP_BLKSIZE_MAX))
+	{
+	  errnum = ERR_BAD_ARGUMENT;
+	  return 1;
+	}
+
+      tftp_set_blksize (size);
+    }
+
+  if (tftp_blksize)
+    grub_printf (" TFTP block size: %d\n", tftp_blksize);
+  else
+    grub_printf (" TFTP block size: %d (automatic)\n", TFTP_BLKSIZE_DEFAULT);
+  return 0;
+}
+
+static struct builtin builtin_tftpblksize =
+{
+  "tftpblksize",
+  tftpblksize_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "tftpblksize [SIZE]",
+  "Display or set the block size requested from the TFTP server. SIZE"
+  " must be between 512 and 65464; 0 selects the automatic default. If"
+  " the server or the firmware refuses the size, 512 is used instead."
+};
+#endif /* PLATFORM_EFI */
+
 
 /* timeout */
 static int
@@ -5281,6 +5512,9 @@ struct builtin *builtin_table[] =
 #ifdef SUPPORT_NETBOOT
   &builtin_bootp,
 #endif /* SUPPORT_NETBOOT */
+#ifdef PLATFORM_EFI
+  &builtin_bootstat,
+#endif
   &builtin_cat,
   &builtin_chainloader,
   &builtin_clear,
@@ -5295,6 +5529,9 @@ struct builtin *builtin_table[] =
 #ifdef SUPPORT_NETBOOT
   &builtin_dhcp,
 #endif /* SUPPORT_NETBOOT */
+#ifdef PLATFORM_EFI
+  &builtin_diskcache,
+#endif
 #ifndef PLATFORM_EFI
   &builtin_displayapm,
 #endif
@@ -5340,6 +5577,9 @@ struct builtin *builtin_table[] =
 #ifdef USE_MD5_PASSWORDS
   &builtin_md5crypt,
 #endif /* USE_MD5_PASSWORDS */
+#ifdef GRUB_UTIL
+  &builtin_memspeed,
+#endif /* GRUB_UTIL */
 #ifndef PLATFORM_EFI
   &builtin_module,
   &builtin_modulenounzip,
@@ -5381,6 +5621,9 @@ struct builtin *builtin_table[] =
 #ifndef PLATFORM_EFI
   &builtin_testvbe,
 #endif
+#ifdef PLATFORM_EFI
+  &builtin_tftpblksize,
+#endif
 #ifdef SUPPORT_NETBOOT
   &builtin_tftpserver,
 #endif /* SUPPORT_NETBOOT */
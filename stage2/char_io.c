@@ -1146,6 +1146,18 @@ grub_isspace (int c)
 int
 grub_memcmp (const char *s1, const char *s2, int n)
 {
+#ifndef STAGE1_5
+  /* Skip the common prefix a word at a time; the bytes of the first
+     differing word are compared below.  */
+  while (n >= (int) sizeof (unsigned long)
+	 && *(const unsigned long *) s1 == *(const unsigned long *) s2)
+    {
+      s1 += sizeof (unsigned long);
+      s2 += sizeof (unsigned long);
+      n -= sizeof (unsigned long);
+    }
+#endif
+
   while (n)
     {
       if (*s1 < *s2)
@@ -1622,12 +1634,95 @@ memcheck (int addr, int len)
 #endif
 }
 
+#ifndef STAGE1_5
+/* Copies and fills of at least this many bytes are done a word at a
+   time.  Shorter ones are not worth aligning the destination for.  */
+# define WORD_COPY_MIN	32
+# define WORD_SIZE	sizeof (unsigned long)
+# ifdef __x86_64__
+#  define MOVS_WORD	"movsq"
+#  define STOS_WORD	"stosq"
+# else
+#  define MOVS_WORD	"movsl"
+#  define STOS_WORD	"stosl"
+# endif
+
+/* Copy LEN bytes upwards: the head up to an aligned destination and the
+   tail a byte at a time, everything in between a word at a time.  Each
+   word is read before it is written, so this is safe for overlapping
+   areas as long as TO is below FROM.  */
+static void
+copy_forward (char *to, const char *from, unsigned long len)
+{
+  unsigned long head, words, d0;
+
+  head = (- (unsigned long) to) & (WORD_SIZE - 1);
+  words = (len - head) / WORD_SIZE;
+
+  asm volatile ("cld\n\t"
+		"rep\n\t"
+		"movsb\n\t"
+		"mov %4, %0\n\t"
+		"rep\n\t"
+		MOVS_WORD "\n\t"
+		"mov %5, %0\n\t"
+		"rep\n\t"
+		"movsb"
+		: "=&c" (d0), "=&S" (from), "=&D" (to)
+		: "0" (head), "rm" (words),
+		  "rm" (len - head - words * WORD_SIZE),
+		  "1" (from), "2" (to)
+		: "memory");
+}
+
+/* The same as copy_forward, but downwards, for when TO is above FROM.  */
+static void
+copy_backward (char *to, const char *from, unsigned long len)
+{
+  unsigned long tail, words, head, d0;
+
+  tail = ((unsigned long) to + len) & (WORD_SIZE - 1);
+  words = (len - tail) / WORD_SIZE;
+  head = len - tail - words * WORD_SIZE;
+
+  /* One statement, so that DF is clear again before any compiled code
+     runs: after the tail, step back to the start of the last word, and
+     after the words, forward again to the last byte of the head.  */
+  asm volatile ("std\n\t"
+		"rep\n\t"
+		"movsb\n\t"
+		"sub %6, %1\n\t"
+		"sub %6, %2\n\t"
+		"mov %4, %0\n\t"
+		"rep\n\t"
+		MOVS_WORD "\n\t"
+		"add %6, %1\n\t"
+		"add %6, %2\n\t"
+		"mov %5, %0\n\t"
+		"rep\n\t"
+		"movsb\n\t"
+		"cld"
+		: "=&c" (d0), "=&S" (from), "=&D" (to)
+		: "0" (tail), "rm" (words), "rm" (head), "i" (WORD_SIZE - 1),
+		  "1" (from + len - 1), "2" (to + len - 1)
+		: "memory", "cc");
+}
+#endif /* ! STAGE1_5 */
+
 void
 grub_memcpy(void *dest, const void *src, int len)
 {
   int i;
   register char *d = (char*)dest, *s = (char*)src;
 
+#ifndef STAGE1_5
+  if (len >= WORD_COPY_MIN)
+    {
+      copy_forward (d, s, len);
+      return;
+    }
+#endif
+
   for (i = 0; i < len; i++)
     d[i] = s[i];
 }
@@ -1642,6 +1737,18 @@ grub_memmove (void *to, const void *from, int len)
 	  but compact.  */
        int d0, d1, d2;
 
+#ifndef STAGE1_5
+       if (len >= WORD_COPY_MIN)
+	 {
+	   /* Downwards misses the fast string moves of current CPUs, so
+	      only copy that way when TO overlaps the end of FROM.  */
+	   if (to < from || (char *) to >= (const char *) from + len)
+	     copy_forward (to, from, len);
+	   else if (to > from)
+	     copy_backward (to, from, len);
+	 }
+       else
+#endif
        if (to < from)
 	 {
 	   asm volatile ("cld\n\t"
@@ -1675,6 +1782,33 @@ grub_memset (void *start, int c, int len)
 
   if (memcheck ((unsigned long) start, len))
     {
+#ifndef STAGE1_5
+      if (len >= WORD_COPY_MIN)
+	{
+	  unsigned long head, words, d0, d1;
+	  unsigned long v = (unsigned char) c * (~0UL / 0xff);
+
+	  head = (- (unsigned long) p) & (WORD_SIZE - 1);
+	  words = (len - head) / WORD_SIZE;
+
+	  asm volatile ("cld\n\t"
+			"rep\n\t"
+			"stosb\n\t"
+			"mov %3, %0\n\t"
+			"rep\n\t"
+			STOS_WORD "\n\t"
+			"mov %4, %0\n\t"
+			"rep\n\t"
+			"stosb"
+			: "=&c" (d0), "=&D" (d1)
+			: "0" (head), "rm" (words),
+			  "rm" (len - head - words * WORD_SIZE),
+			  "a" (v), "1" (p)
+			: "memory");
+	  return errnum ? NULL : start;
+	}
+#endif
+
       while (len -- > 0)
 	*p ++ = c;
     }
@@ -66,9 +66,10 @@ print_cmdline_message (int type)
 struct builtin *
 find_command (char *command)
 {
+  static int num_builtins;
   char *ptr;
   char c;
-  struct builtin **builtin;
+  int low, high;
 
   /* Find the first space and terminate the command name.  */
   ptr = command;
@@ -78,19 +79,29 @@ find_command (char *command)
   c = *ptr;
   *ptr = 0;
 
-  /* Seek out the builtin whose command name is COMMAND.  */
-  for (builtin = builtin_table; *builtin != 0; builtin++)
+  if (! num_builtins)
+    while (builtin_table[num_builtins])
+      num_builtins++;
+
+  /* Seek out the builtin whose command name is COMMAND. BUILTIN_TABLE
+     is sorted by name, so a binary search will do.  */
+  low = 0;
+  high = num_builtins;
+  while (low < high)
     {
-      int ret = grub_strcmp (command, (*builtin)->name);
+      int mid = (low + high) / 2;
+      int ret = grub_strcmp (command, builtin_table[mid]->name);
 
       if (ret == 0)
 	{
 	  /* Find the builtin for COMMAND.  */
 	  *ptr = c;
-	  return *builtin;
+	  return builtin_table[mid];
 	}
       else if (ret < 0)
-	break;
+	high = mid;
+      else
+	low = mid + 1;
     }
 
   /* Cannot find COMMAND.  */
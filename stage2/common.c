@@ -57,6 +57,7 @@ char *err_list[] =
   [ERR_BAD_FILETYPE] = "Bad file or directory type",
   [ERR_BAD_GZIP_DATA] = "Bad or corrupt data while decompressing file",
   [ERR_BAD_GZIP_HEADER] = "Bad or incompatible header in compressed file",
+  [ERR_BAD_GZIP_CRC] = "Checksum mismatch in compressed file",
   [ERR_BAD_PART_TABLE] = "Partition table invalid or corrupt",
   [ERR_BAD_VERSION] = "Mismatched or corrupt version of stage1/stage2",
   [ERR_BELOW_1MB] = "Loading below 1MB is not supported",
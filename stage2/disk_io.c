@@ -30,6 +30,8 @@
 
 #ifdef PLATFORM_EFI
 #include "efistubs.h"
+#include <grub/misc.h>
+#include <grub/efi/efi.h>
 #endif
 
 #ifdef GRUB_UTIL
@@ -37,8 +39,8 @@
 #endif
 
 /* instrumentation variables */
-void (*disk_read_hook) (int, int, int) = NULL;
-void (*disk_read_func) (int, int, int) = NULL;
+void (*disk_read_hook) (grub_sector_t, int, int) = NULL;
+void (*disk_read_func) (grub_sector_t, int, int) = NULL;
 
 #ifndef STAGE1_5
 int print_possibilities;
@@ -49,7 +51,7 @@ static char *unique_string;
 
 #endif
 
-int fsmax;
+grub_filepos_t fsmax;
 struct fsys_entry fsys_table[NUM_FSYS + 1] =
 {
   /* TFTP should come first because others don't handle net device.  */
@@ -124,19 +126,19 @@ static int block_file = 0;
 #endif /* NO_BLOCK_FILES */
 
 /* these are the translated numbers for the open partition */
-unsigned long part_start;
-unsigned long part_length;
+grub_part_sector_t part_start;
+grub_part_sector_t part_length;
 
 int current_slice;
 
 /* disk buffer parameters */
 int buf_drive = -1;
-int buf_track;
+grub_sector_t buf_track;
 struct geometry buf_geom;
 
 /* filesystem common variables */
-int filepos;
-int filemax;
+grub_filepos_t filepos;
+grub_filepos_t filemax;
 
 static inline unsigned int
 grub_log2 (unsigned int word)
@@ -147,10 +149,408 @@ grub_log2 (unsigned int word)
   return word;
 }
 
+#ifdef PLATFORM_EFI
+/*
+ *  The disk cache.  Firmware I/O is slow and there is plenty of memory
+ *  on EFI, so instead of the single track buffer at BUFFERADDR keep many
+ *  recently used blocks of DISK_CACHE_BLOCK_SIZE bytes around, keyed by
+ *  (drive, block), and recycle them in least-recently-used order.
+ */
+
+#define DISK_CACHE_BLOCK_SIZE	0x1000
+#define DISK_CACHE_BLOCK_BITS	12
+#define DISK_CACHE_HASH_SIZE	256
+
+struct disk_cache_entry
+{
+  /* The drive and the block number on it, or -1 if unused.  */
+  int drive;
+  grub_sector_t block;
+  /* The number of valid sectors in DATA.  */
+  int num_sect;
+  char *data;
+  struct disk_cache_entry *hash_next;
+  struct disk_cache_entry *lru_prev;
+  struct disk_cache_entry *lru_next;
+};
+
+/* The cache size in kilobytes. 0 disables the cache.  */
+int disk_cache_size = DISK_CACHE_DEFAULT_SIZE;
+unsigned long disk_cache_hits;
+unsigned long disk_cache_misses;
+
+static struct disk_cache_entry *disk_cache_entries;
+static int disk_cache_num_entries;
+static char *disk_cache_data;
+static grub_efi_uintn_t disk_cache_pages;
+static struct disk_cache_entry *disk_cache_hash[DISK_CACHE_HASH_SIZE];
+/* LRU.LRU_NEXT is the most recently used entry, LRU.LRU_PREV the least.  */
+static struct disk_cache_entry disk_cache_lru;
+
+static inline int
+disk_cache_hash_index (int drive, grub_sector_t block)
+{
+  return (block ^ (drive << 5)) & (DISK_CACHE_HASH_SIZE - 1);
+}
+
+static inline void
+disk_cache_unlink (struct disk_cache_entry *e)
+{
+  e->lru_prev->lru_next = e->lru_next;
+  e->lru_next->lru_prev = e->lru_prev;
+}
+
+static inline void
+disk_cache_link (struct disk_cache_entry *e, struct disk_cache_entry *prev)
+{
+  e->lru_prev = prev;
+  e->lru_next = prev->lru_next;
+  prev->lru_next->lru_prev = e;
+  prev->lru_next = e;
+}
+
+/* Drop E from the hash table and make it the first one to be reused.  */
+static void
+disk_cache_discard (struct disk_cache_entry *e)
+{
+  struct disk_cache_entry **p;
+
+  if (e->drive == -1)
+    return;
+
+  for (p = &disk_cache_hash[disk_cache_hash_index (e->drive, e->block)];
+       *p; p = &(*p)->hash_next)
+    if (*p == e)
+      {
+	*p = e->hash_next;
+	break;
+      }
+
+  e->drive = -1;
+  disk_cache_unlink (e);
+  disk_cache_link (e, disk_cache_lru.lru_prev);
+}
+
+/* Allocate the cache if it is enabled and not allocated yet. Return
+   non-zero if the cache can be used.  */
+static int
+disk_cache_init (void)
+{
+  int i;
+
+  if (disk_cache_entries)
+    return 1;
+
+  disk_cache_num_entries
+    = disk_cache_size >> (DISK_CACHE_BLOCK_BITS - 10);
+  if (disk_cache_num_entries <= 0)
+    return 0;
+
+  disk_cache_entries
+    = grub_malloc (disk_cache_num_entries * sizeof (*disk_cache_entries));
+  if (! disk_cache_entries)
+    return 0;
+
+  /* The blocks are passed to biosdisk as segments, so they must lie
+     below 4GB; grub_efi_allocate_pages guarantees that.  */
+  disk_cache_pages = (disk_cache_num_entries * DISK_CACHE_BLOCK_SIZE
+		      + 4095) >> 12;
+  disk_cache_data = grub_efi_allocate_pages (0, disk_cache_pages);
+  if (! disk_cache_data)
+    {
+      grub_free (disk_cache_entries);
+      disk_cache_entries = 0;
+      return 0;
+    }
+
+  grub_memset (disk_cache_hash, 0, sizeof (disk_cache_hash));
+  disk_cache_lru.lru_prev = disk_cache_lru.lru_next = &disk_cache_lru;
+  for (i = 0; i < disk_cache_num_entries; i++)
+    {
+      struct disk_cache_entry *e = disk_cache_entries + i;
+
+      e->drive = -1;
+      e->data = disk_cache_data + (i << DISK_CACHE_BLOCK_BITS);
+      e->hash_next = 0;
+      disk_cache_link (e, disk_cache_lru.lru_prev);
+    }
+
+  return 1;
+}
+
+static void part_cache_invalidate (int drive);
+static void fsys_cache_invalidate (int drive);
+
+/* Forget all the cached blocks, and the partition tables and the
+   filesystems found with them.  */
+void
+disk_cache_invalidate (void)
+{
+  int i;
+
+  part_cache_invalidate (-1);
+  fsys_cache_invalidate (-1);
+
+  if (! disk_cache_entries)
+    return;
+
+  for (i = 0; i < disk_cache_num_entries; i++)
+    disk_cache_entries[i].drive = -1;
+  grub_memset (disk_cache_hash, 0, sizeof (disk_cache_hash));
+}
+
+/* Forget the cached blocks, partition table and filesystems of DRIVE if
+   its media has been changed since the last check.  */
+static void
+disk_cache_check_media (int drive)
+{
+  int i;
+
+  if (! efidisk_media_changed (drive))
+    return;
+
+  part_cache_invalidate (drive);
+  fsys_cache_invalidate (drive);
+
+  if (! disk_cache_entries)
+    return;
+
+  for (i = 0; i < disk_cache_num_entries; i++)
+    if (disk_cache_entries[i].drive == drive)
+      disk_cache_discard (disk_cache_entries + i);
+}
+
+/* Change the cache size to KBYTES kilobytes. The cache is reallocated
+   on the next read.  */
+void
+disk_cache_resize (int kbytes)
+{
+  if (disk_cache_entries)
+    {
+      grub_efi_free_pages ((grub_efi_physical_address_t)
+			   (grub_addr_t) disk_cache_data,
+			   disk_cache_pages);
+      grub_free (disk_cache_entries);
+      disk_cache_entries = 0;
+    }
+
+  disk_cache_size = kbytes;
+}
+
+/* Forget the cached copy of SECTOR on DRIVE, if any.  */
+static void
+disk_cache_invalidate_sector (int drive, grub_sector_t sector)
+{
+  grub_sector_t block;
+  struct disk_cache_entry *e;
+
+  if (! disk_cache_entries
+      || get_sector_bits (drive) > DISK_CACHE_BLOCK_BITS)
+    return;
+
+  block = sector >> (DISK_CACHE_BLOCK_BITS - get_sector_bits (drive));
+
+  for (e = disk_cache_hash[disk_cache_hash_index (drive, block)];
+       e; e = e->hash_next)
+    if (e->drive == drive && e->block == block)
+      {
+	disk_cache_discard (e);
+	break;
+      }
+}
+
+/* Return the address of the cached data of SECTOR on DRIVE, reading its
+   block from the disk if necessary, and store the number of sectors
+   available from there in *NUM_SECT. SLEN is the number of sectors the
+   caller needs.  Return zero if the block cannot be read.  */
+static char *
+disk_cache_read (int drive, grub_sector_t sector, int slen, int *num_sect)
+{
+  int sector_size_bits = grub_log2 (buf_geom.sector_size);
+  int shift = DISK_CACHE_BLOCK_BITS - sector_size_bits;
+  grub_sector_t block = sector >> shift;
+  int soff = sector - (block << shift);
+  struct disk_cache_entry **head, *e;
+
+  head = &disk_cache_hash[disk_cache_hash_index (drive, block)];
+  for (e = *head; e; e = e->hash_next)
+    if (e->drive == drive && e->block == block)
+      break;
+
+  if (e)
+    disk_cache_hits++;
+  else
+    {
+      grub_sector_t start = block << shift;
+      int len = 1 << shift;
+      int bios_err;
+
+      disk_cache_misses++;
+
+      /* Reuse the least recently used entry.  */
+      e = disk_cache_lru.lru_prev;
+      disk_cache_discard (e);
+
+      if (start + len > buf_geom.total_sectors)
+	len = buf_geom.total_sectors - start;
+
+      bios_err = biosdisk (BIOSDISK_READ, drive, &buf_geom, start, len,
+			   (grub_addr_t) e->data >> 4);
+      if (bios_err == BIOSDISK_ERROR_GEOMETRY)
+	{
+	  errnum = ERR_GEOM;
+	  return 0;
+	}
+      if (bios_err)
+	{
+	  /* Don't cache anything, but try to load only the required
+	     sector(s) rather than failing completely.  */
+	  if (slen > len - soff)
+	    slen = len - soff;
+	  bios_err = biosdisk (BIOSDISK_READ, drive, &buf_geom,
+			       sector, slen, BUFFERSEG);
+	  if (bios_err)
+	    {
+	      errnum = (bios_err == BIOSDISK_ERROR_GEOMETRY
+			? ERR_GEOM : ERR_READ);
+	      return 0;
+	    }
+
+	  *num_sect = slen;
+	  return (char *) BUFFERADDR;
+	}
+
+      if (start == 0
+	  && (PC_SLICE_TYPE (e->data, 0) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (e->data, 1) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (e->data, 2) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (e->data, 3) == PC_SLICE_TYPE_EZD))
+	{
+	  /* This is a EZD disk map sector 0 to sector 1 */
+	  if (len >= 2)
+	    memmove (e->data, e->data + buf_geom.sector_size,
+		     buf_geom.sector_size);
+	  else if (biosdisk (BIOSDISK_READ, drive, &buf_geom, 1, 1,
+			     (grub_addr_t) e->data >> 4))
+	    {
+	      errnum = ERR_READ;
+	      return 0;
+	    }
+	}
+
+      e->drive = drive;
+      e->block = block;
+      e->num_sect = len;
+      e->hash_next = *head;
+      *head = e;
+    }
+
+  /* Make E the most recently used entry.  */
+  disk_cache_unlink (e);
+  disk_cache_link (e, &disk_cache_lru);
+
+  *num_sect = e->num_sect - soff;
+  return e->data + (soff << sector_size_bits);
+}
+#endif /* PLATFORM_EFI */
+
+/* Read the track containing SECTOR on DRIVE into the buffer at BUFFERADDR
+   unless it is there already, and return the address of SECTOR in the
+   buffer. The number of sectors available from there is stored in
+   *NUM_SECT. SLEN is the number of sectors the caller needs.  */
+static char *
+track_read (int drive, grub_sector_t sector, int slen, int *num_sect)
+{
+  grub_sector_t track;
+  int soff, sectors_per_vtrack;
+  int sector_size_bits = grub_log2 (buf_geom.sector_size);
+  char *bufaddr;
+
+  /* Eliminate a buffer overflow.  */
+  if ((buf_geom.sectors << sector_size_bits) > BUFFERLEN)
+    sectors_per_vtrack = (BUFFERLEN >> sector_size_bits);
+  else
+    sectors_per_vtrack = buf_geom.sectors;
+
+  /* Get the first sector of track.  */
+  soff = sector % sectors_per_vtrack;
+  track = sector - soff;
+  *num_sect = sectors_per_vtrack - soff;
+  bufaddr = (char *) BUFFERADDR + (soff << sector_size_bits);
+
+  if (track != buf_track)
+    {
+      grub_sector_t read_start = track;
+      int bios_err, read_len = sectors_per_vtrack;
+
+      /*
+       *  If there's more than one read in this entire loop, then
+       *  only make the earlier reads for the portion needed.  This
+       *  saves filling the buffer with data that won't be used!
+       */
+      if (slen > *num_sect)
+	{
+	  read_start = sector;
+	  read_len = *num_sect;
+	  bufaddr = (char *) BUFFERADDR;
+	}
+
+      bios_err = biosdisk (BIOSDISK_READ, drive, &buf_geom,
+			   read_start, read_len, BUFFERSEG);
+      if (bios_err)
+	{
+	  buf_track = -1;
+
+	  if (bios_err == BIOSDISK_ERROR_GEOMETRY)
+	    errnum = ERR_GEOM;
+	  else
+	    {
+	      /*
+	       *  If there was an error, try to load only the
+	       *  required sector(s) rather than failing completely.
+	       */
+	      if (slen > *num_sect
+		  || biosdisk (BIOSDISK_READ, drive, &buf_geom,
+			       sector, slen, BUFFERSEG))
+		errnum = ERR_READ;
+
+	      bufaddr = (char *) BUFFERADDR;
+	    }
+	}
+      else
+	buf_track = track;
+
+      if ((buf_track == 0 || sector == 0)
+	  && (PC_SLICE_TYPE (BUFFERADDR, 0) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (BUFFERADDR, 1) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (BUFFERADDR, 2) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (BUFFERADDR, 3) == PC_SLICE_TYPE_EZD))
+	{
+	  /* This is a EZD disk map sector 0 to sector 1 */
+	  if (buf_track == 0 || slen >= 2)
+	    {
+	      /* We already read the sector 1, copy it to sector 0 */
+	      memmove ((char *) BUFFERADDR, 
+		       (char *) BUFFERADDR + buf_geom.sector_size,
+		       buf_geom.sector_size);
+	    }
+	  else
+	    {
+	      if (biosdisk (BIOSDISK_READ, drive, &buf_geom,
+			    1, 1, BUFFERSEG))
+		errnum = ERR_READ;
+	    }
+	}
+    }
+
+  return bufaddr;
+}
+
 int
-rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
+rawread (int drive, grub_sector_t sector, int byte_offset, int byte_len,
+	 char *buf)
 {
-  int slen, sectors_per_vtrack;
+  int slen;
   int sector_size_bits = grub_log2 (buf_geom.sector_size);
 
   if (byte_len <= 0)
@@ -158,7 +558,7 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 
   while (byte_len > 0 && !errnum)
     {
-      int soff, num_sect, track, size = byte_len;
+      int num_sect, size = byte_len;
       char *bufaddr;
 
       /*
@@ -167,6 +567,10 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
        */
       if (buf_drive != drive)
 	{
+#ifdef PLATFORM_EFI
+	  /* The user may have exchanged removable disks.  */
+	  disk_cache_check_media (drive);
+#endif
 	  if (get_diskinfo (drive, &buf_geom))
 	    {
 	      errnum = ERR_NO_DISK;
@@ -186,83 +590,37 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
       
       slen = ((byte_offset + byte_len + buf_geom.sector_size - 1)
 	      >> sector_size_bits);
-      
-      /* Eliminate a buffer overflow.  */
-      if ((buf_geom.sectors << sector_size_bits) > BUFFERLEN)
-	sectors_per_vtrack = (BUFFERLEN >> sector_size_bits);
-      else
-	sectors_per_vtrack = buf_geom.sectors;
-      
-      /* Get the first sector of track.  */
-      soff = sector % sectors_per_vtrack;
-      track = sector - soff;
-      num_sect = sectors_per_vtrack - soff;
-      bufaddr = ((char *) BUFFERADDR
-		 + (soff << sector_size_bits) + byte_offset);
-
-      if (track != buf_track)
+
+#ifdef PLATFORM_EFI
+      /* Read large sector-aligned requests directly into BUF, bypassing
+	 both the cache and the buffer at BUFFERADDR. Sector 0 is left to
+	 the cache because of the EZD mapping.  */
+      if (byte_offset == 0 && sector != 0
+	  && byte_len >= DISK_DIRECT_READ_MIN)
 	{
-	  int bios_err, read_start = track, read_len = sectors_per_vtrack;
-
-	  /*
-	   *  If there's more than one read in this entire loop, then
-	   *  only make the earlier reads for the portion needed.  This
-	   *  saves filling the buffer with data that won't be used!
-	   */
-	  if (slen > num_sect)
-	    {
-	      read_start = sector;
-	      read_len = num_sect;
-	      bufaddr = (char *) BUFFERADDR + byte_offset;
-	    }
+	  num_sect = byte_len >> sector_size_bits;
+	  if (num_sect > buf_geom.total_sectors - sector)
+	    num_sect = buf_geom.total_sectors - sector;
 
-	  bios_err = biosdisk (BIOSDISK_READ, drive, &buf_geom,
-			       read_start, read_len, BUFFERSEG);
-	  if (bios_err)
+	  if (efidisk_read (drive, sector, num_sect, buf))
 	    {
-	      buf_track = -1;
-
-	      if (bios_err == BIOSDISK_ERROR_GEOMETRY)
-		errnum = ERR_GEOM;
-	      else
-		{
-		  /*
-		   *  If there was an error, try to load only the
-		   *  required sector(s) rather than failing completely.
-		   */
-		  if (slen > num_sect
-		      || biosdisk (BIOSDISK_READ, drive, &buf_geom,
-				   sector, slen, BUFFERSEG))
-		    errnum = ERR_READ;
-
-		  bufaddr = (char *) BUFFERADDR + byte_offset;
-		}
+	      errnum = ERR_READ;
+	      return 0;
 	    }
-	  else
-	    buf_track = track;
 
-	  if ((buf_track == 0 || sector == 0)
-	      && (PC_SLICE_TYPE (BUFFERADDR, 0) == PC_SLICE_TYPE_EZD
-		  || PC_SLICE_TYPE (BUFFERADDR, 1) == PC_SLICE_TYPE_EZD
-		  || PC_SLICE_TYPE (BUFFERADDR, 2) == PC_SLICE_TYPE_EZD
-		  || PC_SLICE_TYPE (BUFFERADDR, 3) == PC_SLICE_TYPE_EZD))
-	    {
-	      /* This is a EZD disk map sector 0 to sector 1 */
-	      if (buf_track == 0 || slen >= 2)
-		{
-		  /* We already read the sector 1, copy it to sector 0 */
-		  memmove ((char *) BUFFERADDR, 
-			   (char *) BUFFERADDR + buf_geom.sector_size,
-			   buf_geom.sector_size);
-		}
-	      else
-		{
-		  if (biosdisk (BIOSDISK_READ, drive, &buf_geom,
-				1, 1, BUFFERSEG))
-		    errnum = ERR_READ;
-		}
-	    }
+	  bufaddr = buf;
+	}
+      else if (buf_geom.sector_size <= DISK_CACHE_BLOCK_SIZE
+	       && disk_cache_init ())
+	{
+	  bufaddr = disk_cache_read (drive, sector, slen, &num_sect);
+	  if (! bufaddr)
+	    return 0;
 	}
+      else
+#endif
+	bufaddr = track_read (drive, sector, slen, &num_sect);
+      bufaddr += byte_offset;
 	  
       if (size > ((num_sect << sector_size_bits) - byte_offset))
 	size = (num_sect << sector_size_bits) - byte_offset;
@@ -272,7 +630,7 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
        */
       if (disk_read_func)
 	{
-	  int sector_num = sector;
+	  grub_sector_t sector_num = sector;
 	  int length = buf_geom.sector_size - byte_offset;
 	  if (length > size)
 	    length = size;
@@ -289,7 +647,8 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 	    }
 	}
 
-      grub_memmove (buf, bufaddr, size);
+      if (bufaddr != buf)
+	grub_memmove (buf, bufaddr, size);
 
       buf += size;
       byte_len -= size;
@@ -302,7 +661,7 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 
 
 int
-devread (int sector, int byte_offset, int byte_len, char *buf)
+devread (grub_sector_t sector, int byte_offset, int byte_len, char *buf)
 {
   /*
    *  Check partition boundaries
@@ -323,7 +682,7 @@ devread (int sector, int byte_offset, int byte_len, char *buf)
 
 #if !defined(STAGE1_5)
   if (disk_read_hook && debug)
-    printf ("<%d, %d, %d>", sector, byte_offset, byte_len);
+    printf ("<%lld, %d, %d>", (long long) sector, byte_offset, byte_len);
 #endif /* !STAGE1_5 */
 
   /*
@@ -341,7 +700,7 @@ devread (int sector, int byte_offset, int byte_len, char *buf)
 
 #ifndef STAGE1_5
 int
-rawwrite (int drive, int sector, char *buf)
+rawwrite (int drive, grub_sector_t sector, char *buf)
 {
   if (sector == 0)
     {
@@ -370,11 +729,20 @@ rawwrite (int drive, int sector, char *buf)
     /* Clear the cache.  */
     buf_track = -1;
 
+#ifdef PLATFORM_EFI
+  part_cache_invalidate (drive);
+  fsys_cache_invalidate (drive);
+  disk_cache_invalidate_sector (drive, sector);
+  if (sector == 1)
+    /* Sector 0 may be cached as a copy of sector 1 on EZD disks.  */
+    disk_cache_invalidate_sector (drive, 0);
+#endif
+
   return 1;
 }
 
 int
-devwrite (int sector, int sector_count, char *buf)
+devwrite (grub_sector_t sector, int sector_count, char *buf)
 {
 #if defined(GRUB_UTIL) && defined(__linux__)
   if (current_partition != 0xFFFFFF
@@ -425,13 +793,206 @@ sane_partition (void)
 }
 #endif /* ! STAGE1_5 */
 
+#ifdef PLATFORM_EFI
+/*
+ *  The filesystem probe.  Every open_device tries the mount functions in
+ *  the order of FSYS_TABLE until one succeeds, and each of them reads
+ *  its own superblock, so "find", "root" and the completion pay for a
+ *  dozen scattered reads on every partition of every drive.  Instead,
+ *  read the start of the partition, which holds most superblocks, in a
+ *  single request and skip the filesystems whose magic number is not
+ *  there.  Those without a signature below are always tried, and the
+ *  order is kept, so the outcome is the same as trying them all.  The
+ *  filesystem found, or the lack of one, is remembered per partition.
+ */
+
+#define FSYS_PROBE_SIZE		(68 * 1024)
+#define FSYS_PROBE_SECTOR_SIZE	512
+#define FSYS_CACHE_SIZE		32
+
+struct fsys_signature
+{
+  char *name;
+  int offset;
+  int len;
+  char *magic;
+};
+
+/* The magic numbers as found at byte OFFSET of a partition with 512-byte
+   sectors.  A filesystem with several entries needs to match one.  */
+static struct fsys_signature fsys_signatures[] =
+{
+  {"ext2fs", 1024 + 56, 2, "\x53\xef"},
+  {"minix", 1024 + 16, 2, "\x7f\x13"},
+  {"minix", 1024 + 16, 2, "\x8f\x13"},
+  {"reiserfs", 64 * 1024 + 52, 6, "ReIsEr"},
+  {"reiserfs", 8 * 1024 + 52, 6, "ReIsEr"},
+  {"reiserfs", 8 * 1024 + 20, 6, "ReIsEr"},
+  {"vstafs", 0, 4, "\xce\xfa\xad\xde"},
+  {"jfs", 0x8000, 4, "JFS1"},
+  {"xfs", 0, 4, "XFSB"},
+  {0, 0, 0, 0}
+};
+
+struct fsys_cache
+{
+  /* Only hard disks and CD-ROMs are remembered, so a slot whose drive
+     does not have the bit 7 set is unused.  */
+  unsigned long drive;
+  unsigned long partition;
+  grub_part_sector_t start;
+  /* The index into FSYS_TABLE, or NUM_FSYS if nothing mounted.  */
+  int type;
+};
+
+static struct fsys_cache fsys_cache[FSYS_CACHE_SIZE];
+static int fsys_cache_victim;
+static char *fsys_probe_buf;
+
+/* Forget the filesystems of DRIVE, or of all drives if DRIVE is -1.  */
+static void
+fsys_cache_invalidate (int drive)
+{
+  int i;
+
+  for (i = 0; i < FSYS_CACHE_SIZE; i++)
+    if (drive == -1 || fsys_cache[i].drive == (unsigned long) drive)
+      fsys_cache[i].drive = 0;
+}
+
+static struct fsys_cache *
+fsys_cache_lookup (void)
+{
+  int i;
+
+  for (i = 0; i < FSYS_CACHE_SIZE; i++)
+    if (fsys_cache[i].drive == current_drive
+	&& fsys_cache[i].partition == current_partition
+	&& fsys_cache[i].start == part_start)
+      return fsys_cache + i;
+
+  return 0;
+}
+
+static void
+fsys_cache_store (int type)
+{
+  struct fsys_cache *fc = fsys_cache_lookup ();
+
+  if (! fc)
+    {
+      fc = fsys_cache + fsys_cache_victim;
+      fsys_cache_victim = (fsys_cache_victim + 1) % FSYS_CACHE_SIZE;
+    }
+
+  fc->drive = current_drive;
+  fc->partition = current_partition;
+  fc->start = part_start;
+  fc->type = type;
+}
+
+/* Read the start of the current partition and return a mask of the
+   entries of FSYS_TABLE whose signature is missing, or zero if the
+   partition cannot be probed.  */
+static unsigned long
+fsys_probe (void)
+{
+  struct fsys_signature *sig;
+  unsigned long skip = 0;
+  int len, i;
+
+  if (get_sector_size (current_drive) != FSYS_PROBE_SECTOR_SIZE
+      || disk_read_hook || disk_read_func || errnum)
+    return 0;
+
+  if (! fsys_probe_buf)
+    {
+      fsys_probe_buf = grub_malloc (FSYS_PROBE_SIZE);
+      if (! fsys_probe_buf)
+	return 0;
+    }
+
+  len = FSYS_PROBE_SIZE;
+  if (part_length < FSYS_PROBE_SIZE / FSYS_PROBE_SECTOR_SIZE)
+    len = part_length * FSYS_PROBE_SECTOR_SIZE;
+
+  if (! devread (0, 0, len, fsys_probe_buf))
+    {
+      /* Let the mount functions find out for themselves.  */
+      errnum = ERR_NONE;
+      return 0;
+    }
+
+  for (i = 0; i < NUM_FSYS; i++)
+    {
+      int known = 0, found = 0;
+
+      for (sig = fsys_signatures; sig->name; sig++)
+	if (! grub_strcmp (sig->name, fsys_table[i].name))
+	  {
+	    /* Not to be judged by what has not been read.  */
+	    if (sig->offset + sig->len > len)
+	      found = 1;
+	    else if (! grub_memcmp (fsys_probe_buf + sig->offset,
+				    sig->magic, sig->len))
+	      found = 1;
+	    known = 1;
+	  }
+
+      if (known && ! found)
+	skip |= 1UL << i;
+    }
+
+  return skip;
+}
+#endif /* PLATFORM_EFI */
+
 static void
 attempt_mount (void)
 {
 #ifndef STAGE1_5
+#ifdef PLATFORM_EFI
+  unsigned long skip = 0;
+  int cacheable = current_drive & 0x80;
+
+  if (cacheable)
+    {
+      struct fsys_cache *fc;
+
+      disk_cache_check_media (current_drive);
+      fc = fsys_cache_lookup ();
+
+      if (fc)
+	{
+	  fsys_type = fc->type;
+	  if (fsys_type == NUM_FSYS)
+	    {
+	      errnum = ERR_FSYS_MOUNT;
+	      return;
+	    }
+
+	  /* The mount function still has to set up its state.  */
+	  if ((fsys_table[fsys_type].mount_func) ())
+	    return;
+
+	  fc->drive = 0;
+	}
+
+      skip = fsys_probe ();
+    }
+
+  for (fsys_type = 0; fsys_type < NUM_FSYS; fsys_type++)
+    if (! (skip & (1UL << fsys_type))
+	&& (fsys_table[fsys_type].mount_func) ())
+      break;
+
+  if (cacheable && (fsys_type < NUM_FSYS || errnum == ERR_NONE))
+    fsys_cache_store (fsys_type);
+#else
   for (fsys_type = 0; fsys_type < NUM_FSYS; fsys_type++)
     if ((fsys_table[fsys_type].mount_func) ())
       break;
+#endif
 
   if (fsys_type == NUM_FSYS && errnum == ERR_NONE)
     errnum = ERR_FSYS_MOUNT;
@@ -513,7 +1074,8 @@ int
 set_partition_hidden_flag (int hidden)
 {
   unsigned long part = 0xFFFFFF;
-  unsigned long start, len, offset, ext_offset, gpt_offset;
+  grub_part_sector_t start, len, gpt_offset;
+  unsigned long offset, ext_offset;
   int entry, type, gpt_count, gpt_size;
   char mbr[512];
   
@@ -569,7 +1131,9 @@ set_partition_hidden_flag (int hidden)
 static void
 check_and_print_mount (void)
 {
+  bootstat_begin (BOOTSTAT_MOUNT);
   attempt_mount ();
+  bootstat_end (BOOTSTAT_MOUNT, 0);
   if (errnum == ERR_FSYS_MOUNT)
     errnum = ERR_NONE;
   if (!errnum)
@@ -593,10 +1157,10 @@ check_and_print_mount (void)
 int
 next_partition (unsigned long drive, unsigned long dest,
 		unsigned long *partition, int *type,
-		unsigned long *start, unsigned long *len,
+		grub_part_sector_t *start, grub_part_sector_t *len,
 		unsigned long *offset, int *entry,
                unsigned long *ext_offset,
-               unsigned long *gpt_offset, int *gpt_count,
+               grub_part_sector_t *gpt_offset, int *gpt_count,
                int *gpt_size, char *buf)
 {
   /* Forward declarations.  */
@@ -840,6 +1404,234 @@ next_partition (unsigned long drive, unsigned long dest,
   return next_pc_slice ();
 }
 
+#ifdef PLATFORM_EFI
+/*
+ *  The partition table cache.  A walk over the partitions of a drive
+ *  re-reads the MBR for every primary slice and reads every extended
+ *  boot record and every GPT entry on its own, and "find" and the
+ *  device lookups walk the same drives over and over.  So the first
+ *  walk of a hard disk records each step of next_partition, and later
+ *  walks replay the record.  Drives with BSD labels are not recorded,
+ *  since their walk depends on the destination partition, but they are
+ *  remembered so that later walks do not try again.  Callers
+ *  which need the partition table sector in BUF, to change it, use
+ *  next_partition directly.
+ */
+
+#define PART_CACHE_DRIVES	16
+
+struct part_cache_step
+{
+  unsigned long partition;
+  int type;
+  grub_part_sector_t start;
+  grub_part_sector_t len;
+  unsigned long offset;
+  int entry;
+  unsigned long ext_offset;
+  grub_part_sector_t gpt_offset;
+  int gpt_count;
+  int gpt_size;
+};
+
+struct part_cache
+{
+  /* The drive, or anything but a hard disk if unused.  */
+  int drive;
+  /* The number of steps, or -1 if the drive cannot be recorded.  */
+  int num_steps;
+  /* The error which ended the walk.  */
+  grub_error_t last_errnum;
+  /* The step replayed last, which is usually where the next one
+     continues from.  */
+  int cursor;
+  struct part_cache_step *steps;
+};
+
+static struct part_cache part_cache[PART_CACHE_DRIVES];
+static int part_cache_victim;
+
+static void
+part_cache_discard (struct part_cache *pc)
+{
+  grub_free (pc->steps);
+  pc->steps = 0;
+  pc->num_steps = 0;
+  pc->drive = -1;
+}
+
+/* Forget the partition tables of DRIVE, or of all drives if DRIVE is
+   -1.  */
+static void
+part_cache_invalidate (int drive)
+{
+  int i;
+
+  for (i = 0; i < PART_CACHE_DRIVES; i++)
+    if (drive == -1 || part_cache[i].drive == drive)
+      part_cache_discard (part_cache + i);
+}
+
+/* Walk the partitions of DRIVE and record them.  Return the record, or
+   zero if the drive cannot be recorded.  */
+static struct part_cache *
+part_cache_fill (unsigned long drive)
+{
+  struct part_cache *pc;
+  struct part_cache_step step, *steps = 0;
+  int num = 0, max = 0, bsd = 0;
+  char buf[4096];
+
+  step.partition = 0xFFFFFF;
+  while (next_partition (drive, 0xFFFFFF, &step.partition, &step.type,
+			 &step.start, &step.len, &step.offset, &step.entry,
+			 &step.ext_offset, &step.gpt_offset, &step.gpt_count,
+			 &step.gpt_size, buf))
+    {
+      if (IS_PC_SLICE_TYPE_BSD (step.type & 0xff))
+	{
+	  bsd = 1;
+	  break;
+	}
+
+      if (num == max)
+	{
+	  struct part_cache_step *new_steps;
+
+	  max = max ? max * 2 : 16;
+	  new_steps = grub_malloc (max * sizeof (*steps));
+	  if (! new_steps)
+	    break;
+	  if (steps)
+	    {
+	      grub_memmove (new_steps, steps, num * sizeof (*steps));
+	      grub_free (steps);
+	    }
+	  steps = new_steps;
+	}
+
+      steps[num++] = step;
+    }
+
+  /* Only a walk which ran to the end of a readable partition table is
+     worth repeating.  */
+  if (! bsd && errnum != ERR_NO_PART && errnum != ERR_BAD_PART_TABLE)
+    {
+      grub_free (steps);
+      errnum = ERR_NONE;
+      return 0;
+    }
+
+  if (bsd)
+    {
+      grub_free (steps);
+      steps = 0;
+      num = -1;
+    }
+
+  pc = part_cache + part_cache_victim;
+  part_cache_victim = (part_cache_victim + 1) % PART_CACHE_DRIVES;
+  part_cache_discard (pc);
+
+  pc->drive = drive;
+  pc->num_steps = num;
+  pc->last_errnum = errnum;
+  pc->cursor = -1;
+  pc->steps = steps;
+
+  errnum = ERR_NONE;
+  return bsd ? 0 : pc;
+}
+
+/* The same as next_partition, but from the partition table cache where
+   possible.  BUF is not filled in when the cache is used.  */
+int
+next_cached_partition (unsigned long drive, unsigned long dest,
+		       unsigned long *partition, int *type,
+		       grub_part_sector_t *start, grub_part_sector_t *len,
+		       unsigned long *offset, int *entry,
+		       unsigned long *ext_offset,
+		       grub_part_sector_t *gpt_offset, int *gpt_count,
+		       int *gpt_size, char *buf)
+{
+  struct part_cache *pc = 0;
+  struct part_cache_step *step;
+  int i;
+
+  if (! (drive & 0x80) || current_drive == NETWORK_DRIVE)
+    goto uncached;
+
+  disk_cache_check_media (drive);
+
+  /* Unused slots never match, as DRIVE is a hard disk.  */
+  for (i = 0; i < PART_CACHE_DRIVES; i++)
+    if (part_cache[i].drive == drive)
+      {
+	pc = part_cache + i;
+	break;
+      }
+
+  if (pc && pc->num_steps < 0)
+    goto uncached;
+
+  if (*partition == 0xFFFFFF)
+    {
+      if (! pc)
+	pc = part_cache_fill (drive);
+      if (! pc)
+	goto uncached;
+      i = 0;
+    }
+  else
+    {
+      if (! pc)
+	goto uncached;
+
+      /* Find the step returned last time.  */
+#define SAME_STEP(s)	((s)->partition == *partition			\
+			 && (s)->offset == *offset			\
+			 && (s)->entry == *entry			\
+			 && (s)->gpt_offset == *gpt_offset)
+      i = pc->cursor;
+      if (i < 0 || i >= pc->num_steps || ! SAME_STEP (pc->steps + i))
+	{
+	  for (i = 0; i < pc->num_steps; i++)
+	    if (SAME_STEP (pc->steps + i))
+	      break;
+	  if (i == pc->num_steps)
+	    goto uncached;
+	}
+#undef SAME_STEP
+      i++;
+    }
+
+  if (i >= pc->num_steps)
+    {
+      errnum = pc->last_errnum;
+      return 0;
+    }
+
+  pc->cursor = i;
+  step = pc->steps + i;
+  *partition = step->partition;
+  *type = step->type;
+  *start = step->start;
+  *len = step->len;
+  *offset = step->offset;
+  *entry = step->entry;
+  *ext_offset = step->ext_offset;
+  *gpt_offset = step->gpt_offset;
+  *gpt_count = step->gpt_count;
+  *gpt_size = step->gpt_size;
+  return 1;
+
+ uncached:
+  return next_partition (drive, dest, partition, type, start, len,
+			 offset, entry, ext_offset, gpt_offset, gpt_count,
+			 gpt_size, buf);
+}
+#endif /* PLATFORM_EFI */
+
 #ifndef STAGE1_5
 static unsigned long cur_part_offset;
 static unsigned long cur_part_addr;
@@ -852,7 +1644,7 @@ real_open_partition (int flags)
   unsigned long dest_partition = current_partition;
   unsigned long part_offset;
   unsigned long ext_offset;
-  unsigned long gpt_offset;
+  grub_part_sector_t gpt_offset;
   int gpt_count;
   int gpt_size;
   int entry;
@@ -863,7 +1655,7 @@ real_open_partition (int flags)
   auto int next (void);
   int next (void)
     {
-      int ret = next_partition (current_drive, dest_partition,
+      int ret = next_cached_partition (current_drive, dest_partition,
 				&current_partition, &current_slice,
 				&part_start, &part_length,
                                &part_offset, &entry, &ext_offset,
@@ -1224,7 +2016,11 @@ int
 open_device (void)
 {
   if (open_partition ())
-    attempt_mount ();
+    {
+      bootstat_begin (BOOTSTAT_MOUNT);
+      attempt_mount ();
+      bootstat_end (BOOTSTAT_MOUNT, 0);
+    }
 
   if (errnum != ERR_NONE)
     return 0;
@@ -1671,7 +2467,7 @@ grub_open (char *filename)
 #endif /* NO_BLOCK_FILES */
 
   /* This accounts for partial filesystem implementations. */
-  fsmax = MAXINT;
+  fsmax = MAX_FILEPOS;
 
   if (*filename != '/')
     {
@@ -1762,8 +2558,13 @@ grub_open (char *filename)
 }
 
 
-int
-grub_read (char *buf, int len)
+#ifdef PLATFORM_EFI
+/* The largest read passed on to a filesystem at once.  */
+#define GRUB_READ_MAX	0x40000000
+#endif
+
+grub_filepos_t
+grub_read (char *buf, grub_filepos_t len)
 {
   /* Make sure "filepos" is a sane value */
   if ((filepos < 0) || (filepos > filemax))
@@ -1782,6 +2583,29 @@ grub_read (char *buf, int len)
       return 0;
     }
 
+#ifdef PLATFORM_EFI
+  /* The decompressors and the filesystems take an int length, so give
+     them a large read in pieces.  */
+  if (len > GRUB_READ_MAX)
+    {
+      grub_filepos_t ret = 0;
+
+      while (len > 0 && ! errnum)
+	{
+	  int size = len > GRUB_READ_MAX ? GRUB_READ_MAX : len;
+	  int got = grub_read (buf, size);
+
+	  ret += got;
+	  buf += got;
+	  len -= got;
+	  if (got != size)
+	    break;
+	}
+
+      return errnum ? 0 : ret;
+    }
+#endif
+
 #ifndef NO_DECOMPRESSION
   if (compressed_file)
     return gunzip_read (buf, len);
@@ -1790,7 +2614,8 @@ grub_read (char *buf, int len)
 #ifndef NO_BLOCK_FILES
   if (block_file)
     {
-      int size, off, ret = 0;
+      int size, off;
+      grub_filepos_t ret = 0;
       int sector_size = get_sector_size(current_drive);
 
       while (len && !errnum)
@@ -1860,8 +2685,8 @@ grub_read (char *buf, int len)
 
 #ifndef STAGE1_5
 /* Reposition a file offset.  */
-int
-grub_seek (int offset)
+grub_filepos_t
+grub_seek (grub_filepos_t offset)
 {
   if (offset > filemax || offset < 0)
     return -1;
@@ -1899,6 +2724,11 @@ dir (char *dirname)
 void 
 grub_close (void)
 {
+#ifndef NO_DECOMPRESSION
+  if (compressed_file)
+    gunzip_close ();
+#endif /* NO_DECOMPRESSION */
+
 #ifndef NO_BLOCK_FILES
   if (block_file)
     return;
@@ -183,5 +183,5 @@ struct fsys_entry
 extern int print_possibilities;
 #endif
 
-extern int fsmax;
+extern grub_filepos_t fsmax;
 extern struct fsys_entry fsys_table[NUM_FSYS + 1];
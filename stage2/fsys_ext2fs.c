@@ -23,6 +23,9 @@
 #include "filesys.h"
 
 static int mapblock1, mapblock2;
+/* The number of physically contiguous blocks starting at the block
+   returned by the last call to ext2fs_block_map or ext4fs_block_map.  */
+static int map_run;
 
 /* sizes are always in bytes, BLOCK values are always in DEV_BSIZE (sectors) */
 #define DEV_BSIZE get_sector_size(current_drive)
@@ -309,6 +312,8 @@ struct ext4_extent_header
   };
 
 #define EXT4_EXT_MAGIC      (0xf30a)
+/* An extent longer than this is uninitialized.  */
+#define EXT_INIT_MAX_LEN    (1 << 15)
 #define EXT_FIRST_EXTENT(__hdr__) \
     ((struct ext4_extent *) (((char *) (__hdr__)) +     \
                  sizeof(struct ext4_extent_header)))
@@ -429,10 +434,28 @@ ext2_rdfsb (int fsblock, int buffer)
 #ifdef E2DEBUG
   printf ("fsblock %d buffer %d\n", fsblock, buffer);
 #endif /* E2DEBUG */
-  return devread (fsblock * (EXT2_BLOCK_SIZE (SUPERBLOCK) / DEV_BSIZE), 0,
+  return devread ((grub_sector_t) fsblock
+		  * (EXT2_BLOCK_SIZE (SUPERBLOCK) / DEV_BSIZE), 0,
 		  EXT2_BLOCK_SIZE (SUPERBLOCK), (char *) (unsigned long) buffer);
 }
 
+/* Count the entries of the block number array BLOCKS, starting at the
+   index I and below the index N, which refer to consecutive physical
+   blocks.  */
+static int
+ext2_block_run (__u32 *blocks, int i, int n)
+{
+  int run = 1;
+
+  if (blocks[i] == 0)
+    return 1;
+
+  while (i + run < n && blocks[i + run] == blocks[i] + run)
+    run++;
+
+  return run;
+}
+
 /* from
   ext2/inode.c:ext2_bmap()
 */
@@ -469,6 +492,8 @@ ext2fs_block_map (int logical_block)
       printf ("returning %d\n", (unsigned char *) (INODE->i_block[logical_block]));
       printf ("returning %d\n", INODE->i_block[logical_block]);
 #endif /* E2DEBUG */
+      map_run = ext2_block_run (INODE->i_block, logical_block,
+				EXT2_NDIR_BLOCKS);
       return INODE->i_block[logical_block];
     }
   /* else */
@@ -483,6 +508,8 @@ ext2fs_block_map (int logical_block)
 	  return -1;
 	}
       mapblock1 = 1;
+      map_run = ext2_block_run ((__u32 *) DATABLOCK1, logical_block,
+				EXT2_ADDR_PER_BLOCK (SUPERBLOCK));
       return ((__u32 *) DATABLOCK1)[logical_block];
     }
   /* else */
@@ -507,6 +534,10 @@ ext2fs_block_map (int logical_block)
 	  return -1;
 	}
       mapblock2 = bnum;
+      map_run = ext2_block_run ((__u32 *) DATABLOCK2,
+				logical_block
+				& (EXT2_ADDR_PER_BLOCK (SUPERBLOCK) - 1),
+				EXT2_ADDR_PER_BLOCK (SUPERBLOCK));
       return ((__u32 *) DATABLOCK2)
 	[logical_block & (EXT2_ADDR_PER_BLOCK (SUPERBLOCK) - 1)];
     }
@@ -536,6 +567,10 @@ ext2fs_block_map (int logical_block)
       errnum = ERR_FSYS_CORRUPT;
       return -1;
     }
+  map_run = ext2_block_run ((__u32 *) DATABLOCK2,
+			    logical_block
+			    & (EXT2_ADDR_PER_BLOCK (SUPERBLOCK) - 1),
+			    EXT2_ADDR_PER_BLOCK (SUPERBLOCK));
   return ((__u32 *) DATABLOCK2)
     [logical_block & (EXT2_ADDR_PER_BLOCK (SUPERBLOCK) - 1)];
 }
@@ -652,6 +687,14 @@ ext4fs_block_map (int logical_block)
 	  errnum = ERR_FSYS_CORRUPT;
 	  return -1;
 	}
+  /* The rest of the extent is contiguous. An uninitialized extent has
+     EXT_INIT_MAX_LEN added to its length.  */
+  map_run = ex->ee_len;
+  if (map_run > EXT_INIT_MAX_LEN)
+    map_run -= EXT_INIT_MAX_LEN;
+  map_run -= logical_block - ex->ee_block;
+  if (map_run < 1)
+    map_run = 1;
   return ex->ee_start_lo + logical_block - ex->ee_block;
 
 }
@@ -702,7 +745,16 @@ ext2fs_read (char *buf, int len)
       if (map < 0)
 	break;
 
-      size = EXT2_BLOCK_SIZE (SUPERBLOCK);
+      /* Read as many physically contiguous blocks as possible at once.  */
+      if (map != 0 && map_run > 1
+	  && len > EXT2_BLOCK_SIZE (SUPERBLOCK) - offset)
+	{
+	  if (map_run > (len >> EXT2_BLOCK_SIZE_BITS (SUPERBLOCK)) + 2)
+	    map_run = (len >> EXT2_BLOCK_SIZE_BITS (SUPERBLOCK)) + 2;
+	  size = map_run << EXT2_BLOCK_SIZE_BITS (SUPERBLOCK);
+	}
+      else
+	size = EXT2_BLOCK_SIZE (SUPERBLOCK);
       size -= offset;
       if (size > len)
 	size = len;
@@ -712,7 +764,8 @@ ext2fs_read (char *buf, int len)
       } else {
         disk_read_func = disk_read_hook;
 
-        devread (map * (EXT2_BLOCK_SIZE (SUPERBLOCK) / DEV_BSIZE),
+        devread ((grub_sector_t) map
+		 * (EXT2_BLOCK_SIZE (SUPERBLOCK) / DEV_BSIZE),
 	         offset, size, buf);
 
         disk_read_func = NULL;
@@ -969,6 +1022,9 @@ ext2fs_dir (char *dirname)
 	    }
 
 	  filemax = (INODE->i_size);
+#ifdef PLATFORM_EFI
+	  filemax |= (grub_filepos_t) INODE->i_size_high << 32;
+#endif
 	  return 1;
 	}
 
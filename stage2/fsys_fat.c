@@ -44,6 +44,18 @@ struct fat_superblock
   int file_cluster;
   int current_cluster_num;
   int current_cluster;
+  int num_extents;
+};
+
+/* A run of clusters that are contiguous both in the file and on disk.
+   The runs of the current file are recorded as its cluster chain is
+   followed, so that a read covers a whole run at once and a seek finds
+   its cluster without following the chain again.  */
+struct fat_extent
+{
+  int logical;
+  int cluster;
+  int count;
 };
 
 /* pointer(s) into filesystem info buffer for DOS stuff */
@@ -51,8 +63,10 @@ struct fat_superblock
  		    ( FSYS_BUF + 32256) )/* 512 bytes long */
 #define FAT_BUF   ( FSYS_BUF + 28160 )	/* 4 sector FAT buffer */
 #define NAME_BUF  ( FSYS_BUF + 27136 )	/* Filename buffer (833 bytes) */
+#define FAT_EXTENTS ( (struct fat_extent *) FSYS_BUF )	/* 24K extent map */
 
 #define FAT_CACHE_SIZE 4096
+#define FAT_MAX_EXTENTS 2048
 
 static __inline__ unsigned int
 grub_log2 (unsigned int word)
@@ -199,6 +213,154 @@ fat_mount (void)
   return 1;
 }
 
+/* Return the cluster following CLUSTER in its chain, 0 at the end of
+   the chain, or -1 if the FAT is corrupt.  */
+static int
+fat_next_cluster (int cluster)
+{
+  int fat_entry = cluster * FAT_SUPER->fat_size;
+  int cached_pos = (fat_entry - FAT_SUPER->cached_fat);
+  int sector_size = get_sector_size(current_drive);
+  int next_cluster;
+  
+  if (cached_pos < 0 || 
+      (cached_pos + FAT_SUPER->fat_size) > 2*FAT_CACHE_SIZE)
+    {
+      int sector;
+
+      FAT_SUPER->cached_fat = (fat_entry & ~(2*sector_size - 1));
+      cached_pos = (fat_entry - FAT_SUPER->cached_fat);
+      sector = FAT_SUPER->fat_offset
+	+ FAT_SUPER->cached_fat / (2*sector_size);
+      if (!devread (sector, 0, FAT_CACHE_SIZE, (char*) FAT_BUF))
+	return -1;
+    }
+  next_cluster = * (unsigned long *) (FAT_BUF + (cached_pos >> 1));
+  if (FAT_SUPER->fat_size == 3)
+    {
+      if (cached_pos & 1)
+	next_cluster >>= 4;
+      next_cluster &= 0xFFF;
+    }
+  else if (FAT_SUPER->fat_size == 4)
+    next_cluster &= 0xFFFF;
+  
+  if (next_cluster >= FAT_SUPER->clust_eof_marker)
+    return 0;
+  if (next_cluster < 2 || next_cluster >= FAT_SUPER->num_clust)
+    {
+      grub_printf("next_cluster: %d FAT_SUPER->num_clust: %d\n",
+	next_cluster, FAT_SUPER->num_clust);
+      errnum = ERR_FSYS_CORRUPT;
+      return -1;
+    }
+
+  return next_cluster;
+}
+
+/* Forget the extent map, when a new file is opened.  */
+static void
+fat_reset_extents (void)
+{
+  FAT_SUPER->num_extents = 0;
+  FAT_SUPER->current_cluster_num = MAXINT;
+}
+
+/* Find the cluster holding logical cluster LOGICAL of the file and
+   store it in *CLUSTER.  Return how many clusters from there on are
+   contiguous on disk, looking no further than WANT clusters, or 0 past
+   the end of the file, or -1 on error.  */
+static int
+fat_find_run (int logical, int want, int *cluster)
+{
+  struct fat_extent *ext = FAT_EXTENTS;
+  struct fat_extent *last;
+  int low, high, mapped, next;
+
+  if (! FAT_SUPER->num_extents)
+    {
+      ext[0].logical = 0;
+      ext[0].cluster = FAT_SUPER->file_cluster;
+      ext[0].count = 1;
+      FAT_SUPER->num_extents = 1;
+      FAT_SUPER->current_cluster_num = 0;
+      FAT_SUPER->current_cluster = FAT_SUPER->file_cluster;
+    }
+
+  last = ext + FAT_SUPER->num_extents - 1;
+  mapped = last->logical + last->count;
+
+  /* Follow the chain until the map covers LOGICAL and the WANT
+     clusters from there.  CURRENT_CLUSTER is the last cluster
+     followed; it only gets past the end of the map once the map is
+     full, and has to start over from there on a backward seek.  */
+  if (FAT_SUPER->current_cluster_num > logical
+      && FAT_SUPER->current_cluster_num >= mapped)
+    {
+      FAT_SUPER->current_cluster_num = mapped - 1;
+      FAT_SUPER->current_cluster = last->cluster + last->count - 1;
+    }
+
+  while (FAT_SUPER->current_cluster_num < logical
+	 || (FAT_SUPER->current_cluster_num + 1 == mapped
+	     && mapped < logical + want))
+    {
+      next = fat_next_cluster (FAT_SUPER->current_cluster);
+      if (next < 0)
+	return -1;
+      if (! next)
+	{
+	  if (FAT_SUPER->current_cluster_num < logical)
+	    return 0;
+	  break;
+	}
+
+      if (FAT_SUPER->current_cluster_num + 1 == mapped)
+	{
+	  if (next == last->cluster + last->count)
+	    {
+	      last->count++;
+	      mapped++;
+	    }
+	  else if (FAT_SUPER->num_extents < FAT_MAX_EXTENTS)
+	    {
+	      last++;
+	      last->logical = mapped;
+	      last->cluster = next;
+	      last->count = 1;
+	      FAT_SUPER->num_extents++;
+	      mapped++;
+	    }
+	}
+
+      FAT_SUPER->current_cluster_num++;
+      FAT_SUPER->current_cluster = next;
+    }
+
+  if (logical >= mapped)
+    {
+      /* The map is full; go one cluster at a time.  */
+      *cluster = FAT_SUPER->current_cluster;
+      return 1;
+    }
+
+  /* Binary search for the extent holding LOGICAL.  */
+  low = 0;
+  high = FAT_SUPER->num_extents - 1;
+  while (low < high)
+    {
+      int mid = (low + high + 1) / 2;
+
+      if (ext[mid].logical <= logical)
+	low = mid;
+      else
+	high = mid - 1;
+    }
+
+  *cluster = ext[low].cluster + (logical - ext[low].logical);
+  return ext[low].count - (logical - ext[low].logical);
+}
+
 int
 fat_read (char *buf, int len)
 {
@@ -206,7 +368,6 @@ fat_read (char *buf, int len)
   int offset;
   int ret = 0;
   int size;
-  int sector_size = get_sector_size(current_drive);
   
   if (FAT_SUPER->file_cluster < 0)
     {
@@ -222,61 +383,25 @@ fat_read (char *buf, int len)
   
   logical_clust = filepos >> FAT_SUPER->clustsize_bits;
   offset = (filepos & ((1 << FAT_SUPER->clustsize_bits) - 1));
-  if (logical_clust < FAT_SUPER->current_cluster_num)
-    {
-      FAT_SUPER->current_cluster_num = 0;
-      FAT_SUPER->current_cluster = FAT_SUPER->file_cluster;
-    }
   
   while (len > 0)
     {
-      int sector;
-      while (logical_clust > FAT_SUPER->current_cluster_num)
-	{
-	  /* calculate next cluster */
-	  int fat_entry = 
-	    FAT_SUPER->current_cluster * FAT_SUPER->fat_size;
-	  int next_cluster;
-	  int cached_pos = (fat_entry - FAT_SUPER->cached_fat);
-	  
-	  if (cached_pos < 0 || 
-	      (cached_pos + FAT_SUPER->fat_size) > 2*FAT_CACHE_SIZE)
-	    {
-	      FAT_SUPER->cached_fat = (fat_entry & ~(2*sector_size - 1));
-	      cached_pos = (fat_entry - FAT_SUPER->cached_fat);
-	      sector = FAT_SUPER->fat_offset
-		+ FAT_SUPER->cached_fat / (2*sector_size);
-	      if (!devread (sector, 0, FAT_CACHE_SIZE, (char*) FAT_BUF))
-		return 0;
-	    }
-	  next_cluster = * (unsigned long *) (FAT_BUF + (cached_pos >> 1));
-	  if (FAT_SUPER->fat_size == 3)
-	    {
-	      if (cached_pos & 1)
-		next_cluster >>= 4;
-	      next_cluster &= 0xFFF;
-	    }
-	  else if (FAT_SUPER->fat_size == 4)
-	    next_cluster &= 0xFFFF;
-	  
-	  if (next_cluster >= FAT_SUPER->clust_eof_marker)
-	    return ret;
-	  if (next_cluster < 2 || next_cluster >= FAT_SUPER->num_clust)
-	    {
-	      grub_printf("next_cluster: %d FAT_SUPER->num_clust: %d\n",
-		next_cluster, FAT_SUPER->num_clust);
-	      errnum = ERR_FSYS_CORRUPT;
-	      return 0;
-	    }
-	  
-	  FAT_SUPER->current_cluster = next_cluster;
-	  FAT_SUPER->current_cluster_num++;
-	}
+      grub_sector_t sector;
+      int cluster, count;
+      int want = ((offset + len - 1) >> FAT_SUPER->clustsize_bits) + 1;
+
+      count = fat_find_run (logical_clust, want, &cluster);
+      if (count < 0)
+	return 0;
+      if (count == 0)
+	return ret;
+      if (count > want)
+	count = want;
       
-      sector = FAT_SUPER->data_offset +
-	((FAT_SUPER->current_cluster - 2) << (FAT_SUPER->clustsize_bits
- 					      - FAT_SUPER->sectsize_bits));
-      size = (1 << FAT_SUPER->clustsize_bits) - offset;
+      sector = FAT_SUPER->data_offset
+	+ ((grub_sector_t) (cluster - 2)
+	   << (FAT_SUPER->clustsize_bits - FAT_SUPER->sectsize_bits));
+      size = (count << FAT_SUPER->clustsize_bits) - offset;
       if (size > len)
 	size = len;
       
@@ -290,7 +415,7 @@ fat_read (char *buf, int len)
       buf += size;
       ret += size;
       filepos += size;
-      logical_clust++;
+      logical_clust += count;
       offset = 0;
     }
   return errnum ? 0 : ret;
@@ -316,7 +441,7 @@ fat_dir (char *dirname)
   
   FAT_SUPER->file_cluster = FAT_SUPER->root_cluster;
   filepos = 0;
-  FAT_SUPER->current_cluster_num = MAXINT;
+  fat_reset_extents ();
   
   /* main loop to find desired directory entry */
  loop:
@@ -488,7 +613,7 @@ fat_dir (char *dirname)
   filemax = FAT_DIRENTRY_FILELENGTH (dir_buf);
   filepos = 0;
   FAT_SUPER->file_cluster = FAT_DIRENTRY_FIRST_CLUSTER (dir_buf);
-  FAT_SUPER->current_cluster_num = MAXINT;
+  fat_reset_extents ();
   
   /* go back to main loop at top of function */
   goto loop;
@@ -231,7 +231,8 @@ jfs_read (char *buf, int len)
 	xad_t *xad;
 	s64 endofprev, endofcur;
 	s64 offset, xadlen;
-	int toread, startpos, endpos;
+	int toread;
+	grub_filepos_t startpos, endpos;
 
 	startpos = filepos;
 	endpos = filepos + len;
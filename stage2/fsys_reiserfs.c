@@ -383,7 +383,8 @@ is_power_of_two (unsigned long word)
 static int 
 journal_read (int block, int len, char *buffer) 
 {
-  return devread ((INFO->journal_block + block) << INFO->blocksize_shift, 
+  return devread ((grub_sector_t) (INFO->journal_block + block)
+		  << INFO->blocksize_shift, 
 		  0, len, buffer);
 }
 
@@ -457,7 +458,8 @@ block_read (int blockNr, int start, int len, char *buffer)
     not_found:
       desc_block = (desc_block + 2 + j_len) & journal_mask;
     }
-  return devread (translatedNr << INFO->blocksize_shift, start, len, buffer);
+  return devread ((grub_sector_t) translatedNr << INFO->blocksize_shift,
+		  start, len, buffer);
 }
 
 /* Init the journal data structure.  We try to cache as much as
@@ -963,7 +965,7 @@ reiserfs_read (char *buf, int len)
 	      /* Journal is only for meta data.  Data blocks can be read
 	       * directly without using block_read
 	       */
-	      devread (blocknr << INFO->blocksize_shift,
+	      devread ((grub_sector_t) blocknr << INFO->blocksize_shift,
 		       blk_offset, to_read, buf);
 	      
 	      disk_read_func = NULL;
@@ -1100,12 +1102,20 @@ reiserfs_dir (char *dirname)
 	  filepos = 0;
 	  filemax = ((struct stat_data *) INFO->current_item)->sd_size;
 	  
+#ifdef PLATFORM_EFI
+	  /* A new stat data has the high 32 bits of the size as well.  */
+	  if (INFO->current_ih->ih_version == ITEM_VERSION_2)
+	    filemax |= ((grub_filepos_t)
+			((struct stat_data *) INFO->current_item)->sd_size_hi
+			<< 32);
+#else
 	  /* If this is a new stat data and size is > 4GB set filemax to 
 	   * maximum
 	   */
 	  if (INFO->current_ih->ih_version == ITEM_VERSION_2
 	      && ((struct stat_data *) INFO->current_item)->sd_size_hi > 0)
 	    filemax = 0xffffffff;
+#endif
 	  
 	  INFO->fileinfo.k_dir_id = dir_id;
 	  INFO->fileinfo.k_objectid = objectid;
@@ -39,7 +39,7 @@ static struct dir_entry *vstafs_nextdir (void);
  * In f_sector we store the sector number in which the information about
  * the found file is.
  */
-extern int filepos;
+extern grub_filepos_t filepos;
 static int f_sector;
 
 int 
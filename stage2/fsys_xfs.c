@@ -493,7 +493,8 @@ xfs_read (char *buf, int len)
 	xad_t *xad;
 	xfs_fileoff_t endofprev, endofcur, offset;
 	xfs_filblks_t xadlen;
-	int toread, startpos, endpos;
+	int toread;
+	grub_filepos_t startpos, endpos;
 
 	if (icore.di_format == XFS_DINODE_FMT_LOCAL) {
 		grub_memmove (buf, inode->di_u.di_c + filepos, len);
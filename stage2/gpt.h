@@ -20,6 +20,9 @@
 #ifndef _GPT_H
 #define _GPT_H
 
+#ifdef PLATFORM_EFI
+#include <grub/types.h>
+#else
 typedef signed char grub_int8_t;
 typedef signed short grub_int16_t;
 typedef signed int grub_int32_t;
@@ -28,6 +31,7 @@ typedef unsigned char grub_uint8_t;
 typedef unsigned short grub_uint16_t;
 typedef unsigned int grub_uint32_t;
 typedef unsigned long long int grub_uint64_t;
+#endif
 
 struct grub_gpt_header
 {
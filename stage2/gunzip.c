@@ -129,6 +129,10 @@
 
 #include "filesys.h"
 
+#ifdef PLATFORM_EFI
+#include <grub/misc.h>
+#endif
+
 /* so we can disable decompression  */
 int no_decompression = 0;
 
@@ -136,13 +140,172 @@ int no_decompression = 0;
 int compressed_file;
 
 /* internal variables only */
-static int gzip_data_offset;
-static int gzip_filepos;
-static int gzip_filemax;
-static int gzip_fsmax;
-static int saved_filepos;
+static grub_filepos_t gzip_data_offset;
+static grub_filepos_t gzip_filepos;
+static grub_filepos_t gzip_filemax;
+static grub_filepos_t gzip_fsmax;
+static grub_filepos_t saved_filepos;
 static unsigned int gzip_crc;
 
+/* The CRC of the uncompressed data so far, and how far that is.  It is
+   only computed the first time through, since seeking back does not
+   change the data.  */
+static unsigned int crc_value;
+static grub_filepos_t crc_pos;
+
+#ifdef PLATFORM_EFI
+/* Other compression formats, recognized by their magic once the file
+   turns out not to be gzipped.  TEST_FUNC gets the first bytes of the
+   file and says whether they are its magic.  None of these formats
+   can be read piecemeal the way gzip is, so the whole file is then
+   handed to DECODE_FUNC, which appends the uncompressed data to
+   "decomp_data" using the helpers below, and reads are served from
+   there until the file is closed.  */
+struct decompressor
+{
+  char *name;
+  int (*test_func) (unsigned char *buf, int len);
+  int (*decode_func) (const unsigned char *src, int size);
+};
+
+static struct decompressor decompressor_table[] =
+{
+  {"lz4", unlz4_test, unlz4_decode},
+  {"xz", unxz_test, unxz_decode},
+  {"zstd", unzstd_test, unzstd_decode},
+  {0, 0, 0}
+};
+
+/* The decompressor for the current file, or NULL for gzip.  */
+static struct decompressor *decompressor;
+
+/* The uncompressed data so far, and how much room there is for it.  */
+unsigned char *decomp_data;
+int decomp_size;
+static int decomp_alloc;
+
+/* Move the data into a buffer of ALLOC bytes.  */
+static int
+decomp_resize (int alloc)
+{
+  unsigned char *data;
+
+  data = grub_malloc (alloc);
+  if (! data)
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  if (decomp_data)
+    {
+      grub_memmove (data, decomp_data, decomp_size);
+      grub_free (decomp_data);
+    }
+  decomp_data = data;
+  decomp_alloc = alloc;
+  return 1;
+}
+
+/* Make room for at least LEN more bytes of output.  */
+int
+decomp_reserve (unsigned int len)
+{
+  int alloc;
+
+  if (len > (unsigned int) (MAXINT - decomp_size))
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  if (decomp_size + (int) len <= decomp_alloc)
+    return 1;
+
+  alloc = decomp_alloc ? decomp_alloc : 0x10000;
+  while (alloc < decomp_size + (int) len)
+    alloc = alloc > MAXINT / 2 ? MAXINT : alloc * 2;
+
+  return decomp_resize (alloc);
+}
+
+/* The stream says that SIZE more bytes of output follow, so make room
+   for exactly that much rather than growing by doubling.  */
+int
+decomp_expect (unsigned long long size)
+{
+  if (size > (unsigned long long) (MAXINT - decomp_size))
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  if (decomp_size + (int) size <= decomp_alloc)
+    return 1;
+
+  return decomp_resize (decomp_size + (int) size);
+}
+
+static void
+decomp_free (void)
+{
+  grub_free (decomp_data);
+  decomp_data = 0;
+  decomp_size = decomp_alloc = 0;
+}
+
+/* Read the whole file, which D has claimed, and decompress it.  */
+static int
+decomp_whole_file (struct decompressor *d)
+{
+  unsigned char *src;
+  int size;
+
+  if (filemax > MAXINT)
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  bootstat_begin (BOOTSTAT_DECOMPRESS);
+
+  size = filemax;
+  src = grub_malloc (size);
+  if (! src)
+    {
+      errnum = ERR_WONT_FIT;
+      bootstat_end (BOOTSTAT_DECOMPRESS, 0);
+      return 0;
+    }
+
+  filepos = 0;
+  if (grub_read ((char *) src, size) != size)
+    {
+      grub_free (src);
+      if (! errnum)
+	errnum = ERR_READ;
+      bootstat_end (BOOTSTAT_DECOMPRESS, 0);
+      return 0;
+    }
+
+  d->decode_func (src, size);
+  grub_free (src);
+  bootstat_end (BOOTSTAT_DECOMPRESS, decomp_size);
+
+  if (errnum)
+    {
+      decomp_free ();
+      return 0;
+    }
+
+  decompressor = d;
+  compressed_file = 1;
+  filepos = 0;
+  filemax = fsmax = decomp_size;
+  return 1;
+}
+#endif
+
 /* internal extra variables for use of inflate code */
 static int block_type;
 static int block_len;
@@ -166,25 +329,31 @@ linalloc (int size)
   return (void *) linalloc_topaddr;
 }
 
-static void
-reset_linalloc (void)
+static unsigned long
+linalloc_top (void)
 {
 #ifdef PLATFORM_EFI
   unsigned int top = (mbi.mem_upper << 10) + 0x100000;
   if (top > GRUB_SCRATCH_MEM_SIZE)
     top = GRUB_SCRATCH_MEM_SIZE;
-  linalloc_topaddr = RAW_ADDR (top);
+  return RAW_ADDR (top);
 #else
-  linalloc_topaddr = RAW_ADDR ((mbi.mem_upper << 10) + 0x100000);
+  return RAW_ADDR ((mbi.mem_upper << 10) + 0x100000);
 #endif
 }
 
+static void
+reset_linalloc (void)
+{
+  linalloc_topaddr = linalloc_top ();
+}
+
 
 /* internal variable swap function */
 static void
 gunzip_swap_values (void)
 {
-  register int itmp;
+  grub_filepos_t itmp;
 
   /* swap filepos */
   itmp = filepos;
@@ -271,6 +440,12 @@ typedef unsigned int ulg;
 #define WSIZE 0x8000
 
 
+#ifdef PLATFORM_EFI
+static void free_checkpoints (void);
+static void set_checkpoint_interval (void);
+static void save_checkpoint (void);
+#endif
+
 int
 gunzip_test_header (void)
 {
@@ -278,6 +453,8 @@ gunzip_test_header (void)
   
   /* "compressed_file" is already reset to zero by this point */
 
+  gunzip_close ();
+
   /*
    *  This checks if the file is gzipped.  If a problem occurs here
    *  (other than a real error with the disk) then we don't think it
@@ -288,6 +465,17 @@ gunzip_test_header (void)
       || ((*((unsigned short *) buf) != GZIP_HDR_LE)
 	  && (*((unsigned short *) buf) != OLD_GZIP_HDR_LE)))
     {
+#ifdef PLATFORM_EFI
+      if (! no_decompression && ! errnum)
+	{
+	  struct decompressor *d;
+	  int len = filepos;
+
+	  for (d = decompressor_table; d->name; d++)
+	    if (d->test_func (buf, len))
+	      return decomp_whole_file (d);
+	}
+#endif
       filepos = 0;
       return ! errnum;
     }
@@ -326,7 +514,13 @@ gunzip_test_header (void)
   gzip_crc = *((unsigned int *) buf);
   gzip_fsmax = gzip_filemax = *((unsigned int *) (buf + 4));
 
+  crc_value = 0xffffffff;
+  crc_pos = 0;
+
   initialize_tables ();
+#ifdef PLATFORM_EFI
+  set_checkpoint_interval ();
+#endif
 
   compressed_file = 1;
   gunzip_swap_values ();
@@ -371,7 +565,15 @@ struct huft
 
 
 /* sliding window in uncompressed data */
-static uch slide[WSIZE];
+static uch window[WSIZE];
+
+/* Where the current window is decoded.  This is normally WINDOW, but a
+   large sequential gunzip_read decodes straight into the caller's buffer,
+   one WSIZE piece at a time.  PREV_SLIDE holds the previous WSIZE bytes of
+   output, which copies may refer back to; when decoding into WINDOW in
+   the usual circular fashion it is the same as SLIDE.  */
+static uch *slide = window;
+static uch *prev_slide = window;
 
 /* current position in slide */
 static unsigned wp;
@@ -487,21 +689,28 @@ static ush mask_bits[] =
   0x01ff, 0x03ff, 0x07ff, 0x0fff, 0x1fff, 0x3fff, 0x7fff, 0xffff
 };
 
-#define NEEDBITS(n) do {while(k<(n)){b|=((ulg)get_byte())<<k;k+=8;}} while (0)
+/* NEEDBITS tops the bit buffer up to more than 24 bits whenever it runs
+   short, so that most codes are decoded without going back to the input.
+   The bytes read ahead this way stay in the bit buffer; stored blocks
+   take them from there before reading further input.  */
+#define NEEDBITS(n) do {if(k<(n)){do{b|=((ulg)NEXTBYTE())<<k;k+=8;}while(k<=24);}} while (0)
 #define DUMPBITS(n) do {b>>=(n);k-=(n);} while (0)
 
 #define INBUFSIZ  0x2000
 
 static uch inbuf[INBUFSIZ];
 static int bufloc;
+static int inbuf_fill;		/* bytes actually read into inbuf */
+
+#define NEXTBYTE()	(bufloc < INBUFSIZ ? inbuf[bufloc++] : get_byte ())
 
 static int
 get_byte (void)
 {
-  if (filepos == gzip_data_offset || bufloc == INBUFSIZ)
+  if (bufloc == INBUFSIZ)
     {
       bufloc = 0;
-      grub_read (inbuf, INBUFSIZ);
+      inbuf_fill = grub_read (inbuf, INBUFSIZ);
     }
 
   return inbuf[bufloc++];
@@ -719,11 +928,16 @@ huft_build (unsigned *b,	/* code lengths in bits (all assumed <= BMAX) */
 
 static unsigned inflate_n, inflate_d;
 
+/* Copies shorter than this are done inline; most matches are only a
+   few bytes long, and a call to memmove costs more than it saves.  */
+#define SHORT_COPY	64
+
 static int
 inflate_codes_in_window (void)
 {
   register unsigned e;		/* table entry flag/number of extra bits */
   unsigned n, d;		/* length and index for copy */
+  uch *src;			/* source of copy */
   unsigned w;			/* current window position */
   struct huft *t;		/* pointer to table entry */
   unsigned ml, md;		/* masks for bl and bd bits */
@@ -810,19 +1024,25 @@ inflate_codes_in_window (void)
 	  /* do the copy */
 	  do
 	    {
-	      n -= (e = (e = WSIZE - ((d &= WSIZE - 1) > w ? d : w)) > n ? n
+	      n -= (e = (e = WSIZE - ((d &= WSIZE - 1) >= w ? d : w)) > n ? n
 		    : e);
-	      if (w - d >= e)
+	      /* D at or above W refers to the previous window */
+	      src = (d >= w ? prev_slide : slide) + d;
+	      if (e >= SHORT_COPY && (d >= w || w - d >= e))
 		{
-		  memmove (slide + w, slide + d, e);
+		  memmove (slide + w, src, e);
 		  w += e;
 		  d += e;
 		}
 	      else
 		/* purposefully use the overlap for extra copies here!! */
 		{
+		  uch *dst = slide + w;
+
+		  w += e;
+		  d += e;
 		  while (e--)
-		    slide[w++] = slide[d++];
+		    *dst++ = *src++;
 		}
 	      if (w == WSIZE)
 		break;
@@ -879,9 +1099,16 @@ init_stored_block (void)
 }
 
 
-/* get header for an inflated type 1 (fixed Huffman codes) block.  We should
-   either replace this with a custom decoder, or at least precompute the
-   Huffman tables. */
+/* get header for an inflated type 1 (fixed Huffman codes) block.  The
+   tables never change, so they are built once, in their own storage
+   rather than the linear allocator that is reset after every block. */
+
+/* The fixed literal/length and distance tables take 658 entries.  */
+#define FIXED_HUFTS	660
+
+static struct huft fixed_hufts[FIXED_HUFTS];
+static struct huft *fixed_tl, *fixed_td;
+static int fixed_bl, fixed_bd;
 
 static void
 init_fixed_block ()
@@ -889,6 +1116,20 @@ init_fixed_block ()
   int i;			/* temporary variable */
   unsigned l[288];		/* length list for huft_build */
 
+  if (fixed_tl)
+    {
+      tl = fixed_tl;
+      td = fixed_td;
+      bl = fixed_bl;
+      bd = fixed_bd;
+      code_state = 0;
+      block_len++;
+      return;
+    }
+
+  /* build the tables at the top of FIXED_HUFTS */
+  linalloc_topaddr = (unsigned long) (fixed_hufts + FIXED_HUFTS);
+
   /* set up literal table */
   for (i = 0; i < 144; i++)
     l[i] = 8;
@@ -901,6 +1142,7 @@ init_fixed_block ()
   bl = 7;
   if ((i = huft_build (l, 288, 257, cplens, cplext, &tl, &bl)) != 0)
     {
+      reset_linalloc ();
       errnum = ERR_BAD_GZIP_DATA;
       return;
     }
@@ -915,6 +1157,12 @@ init_fixed_block ()
       return;
     }
 
+  fixed_tl = tl;
+  fixed_td = td;
+  fixed_bl = bl;
+  fixed_bd = bd;
+  reset_linalloc ();
+
   /* indicate we're now working on a block */
   code_state = 0;
   block_len++;
@@ -1104,6 +1352,75 @@ get_new_block (void)
 }
 
 
+/*
+ *  CRC-32 as used by gzip, computed eight bytes at a time ("slicing by
+ *  eight").  crc_table[0] is the usual byte-wise table; crc_table[k]
+ *  gives the effect of a byte followed by K zero bytes.
+ */
+
+static ulg crc_table[8][256];
+
+static void
+make_crc_table (void)
+{
+  ulg c;
+  int n, k;
+
+  for (n = 0; n < 256; n++)
+    {
+      c = n;
+      for (k = 0; k < 8; k++)
+	c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      crc_table[0][n] = c;
+    }
+
+  for (n = 0; n < 256; n++)
+    {
+      c = crc_table[0][n];
+      for (k = 1; k < 8; k++)
+	{
+	  c = crc_table[0][c & 0xff] ^ (c >> 8);
+	  crc_table[k][n] = c;
+	}
+    }
+}
+
+static ulg
+update_crc (ulg c, uch *p, unsigned len)
+{
+  if (! crc_table[0][1])
+    make_crc_table ();
+
+  while (len && ((unsigned long) p & 3))
+    {
+      c = crc_table[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+      len--;
+    }
+
+  while (len >= 8)
+    {
+      ulg one = *(ulg *) p ^ c;
+      ulg two = *(ulg *) (p + 4);
+
+      c = crc_table[7][one & 0xff]
+	^ crc_table[6][(one >> 8) & 0xff]
+	^ crc_table[5][(one >> 16) & 0xff]
+	^ crc_table[4][one >> 24]
+	^ crc_table[3][two & 0xff]
+	^ crc_table[2][(two >> 8) & 0xff]
+	^ crc_table[1][(two >> 16) & 0xff]
+	^ crc_table[0][two >> 24];
+      p += 8;
+      len -= 8;
+    }
+
+  while (len--)
+    c = crc_table[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+
+  return c;
+}
+
+
 static void
 inflate_window (void)
 {
@@ -1138,15 +1455,40 @@ inflate_window (void)
 	  int w = wp;
 
 	  /*
-	   *  This is basically a glorified pass-through
+	   *  This is basically a glorified pass-through.  Whole bytes
+	   *  left in the bit buffer come first.
 	   */
 
-	  while (block_len && w < WSIZE && !errnum)
+	  while (block_len && w < WSIZE && bk >= 8)
 	    {
-	      slide[w++] = get_byte ();
+	      slide[w++] = (uch) bb;
+	      bb >>= 8;
+	      bk -= 8;
 	      block_len--;
 	    }
 
+	  while (block_len && w < WSIZE && !errnum)
+	    {
+	      int size;
+
+	      if (bufloc == INBUFSIZ)
+		{
+		  bufloc = 0;
+		  inbuf_fill = grub_read ((char *) inbuf, INBUFSIZ);
+		}
+
+	      size = INBUFSIZ - bufloc;
+	      if (size > block_len)
+		size = block_len;
+	      if (size > WSIZE - w)
+		size = WSIZE - w;
+
+	      memmove (slide + w, inbuf + bufloc, size);
+	      bufloc += size;
+	      w += size;
+	      block_len -= size;
+	    }
+
 	  wp = w;
 
 	  continue;
@@ -1160,10 +1502,176 @@ inflate_window (void)
 	reset_linalloc ();
     }
 
+  /* check the data against the gzip trailer the first time through */
+  if (saved_filepos == crc_pos && ! errnum)
+    {
+      grub_filepos_t size = gzip_filemax - crc_pos;
+
+      if (size > (int) wp)
+	size = wp;
+      crc_value = update_crc (crc_value, slide, size);
+      crc_pos += size;
+      if (crc_pos == gzip_filemax && ~crc_value != gzip_crc)
+	errnum = ERR_BAD_GZIP_CRC;
+    }
+
   saved_filepos += WSIZE;
 
-  /* XXX do CRC calculation here! */
+#ifdef PLATFORM_EFI
+  save_checkpoint ();
+#endif
+}
+
+
+#ifdef PLATFORM_EFI
+/*
+ *  Checkpoint index.
+ *
+ *  Backward seeks used to restart decompression from the beginning of
+ *  the file.  Instead, the complete decoder state is recorded every
+ *  CHECKPOINT_INTERVAL bytes of output the first time through: the
+ *  window, the bit buffer, the position in the compressed data, and the
+ *  Huffman tables of the current block.  A seek resumes from the closest
+ *  checkpoint at or before the target.
+ *
+ *  The tables contain pointers into the linear allocator's area, so they
+ *  are saved as a copy of that area and put back at the same address.
+ */
+
+#define MAX_CHECKPOINTS		64
+#define MIN_CHECKPOINT_INTERVAL	0x100000
+
+struct checkpoint
+{
+  grub_filepos_t out_pos;	/* saved_filepos */
+  grub_filepos_t in_pos;	/* compressed offset of the next input byte */
+  ulg bb;
+  unsigned bk;
+  int block_type;
+  int block_len;
+  int last_block;
+  int code_state;
+  unsigned inflate_n, inflate_d;
+  struct huft *tl, *td;
+  int bl, bd;
+  unsigned long linalloc_topaddr;
+  unsigned long linalloc_top;
+  int huft_size;
+  /* The window, followed by HUFT_SIZE bytes of tables.  */
+  uch data[0];
+};
+
+static struct checkpoint *checkpoints[MAX_CHECKPOINTS];
+static int num_checkpoints;
+static int checkpoint_interval;
+
+static void
+free_checkpoints (void)
+{
+  while (num_checkpoints)
+    grub_free (checkpoints[--num_checkpoints]);
+}
+
+/* Called with the "gzip_*" values referring to the uncompressed data.  */
+static void
+set_checkpoint_interval (void)
+{
+  checkpoint_interval = gzip_filemax / MAX_CHECKPOINTS;
+  if (checkpoint_interval < MIN_CHECKPOINT_INTERVAL)
+    checkpoint_interval = MIN_CHECKPOINT_INTERVAL;
+  checkpoint_interval = (checkpoint_interval + WSIZE - 1) & ~(WSIZE - 1);
+}
+
+/* Record the state at the end of the window just inflated, if it is due
+   for a checkpoint.  */
+static void
+save_checkpoint (void)
+{
+  struct checkpoint *cp;
+  int huft_size;
+
+  if (errnum || saved_filepos % checkpoint_interval
+      || num_checkpoints == MAX_CHECKPOINTS
+      || (num_checkpoints
+	  && checkpoints[num_checkpoints - 1]->out_pos >= saved_filepos))
+    return;
+
+  huft_size = block_len ? linalloc_top () - linalloc_topaddr : 0;
+  cp = grub_malloc (sizeof (*cp) + WSIZE + huft_size);
+  if (! cp)
+    return;
+
+  cp->out_pos = saved_filepos;
+  cp->in_pos = filepos - inbuf_fill + bufloc;
+  cp->bb = bb;
+  cp->bk = bk;
+  cp->block_type = block_type;
+  cp->block_len = block_len;
+  cp->last_block = last_block;
+  cp->code_state = code_state;
+  cp->inflate_n = inflate_n;
+  cp->inflate_d = inflate_d;
+  cp->tl = tl;
+  cp->td = td;
+  cp->bl = bl;
+  cp->bd = bd;
+  cp->linalloc_topaddr = linalloc_topaddr;
+  cp->linalloc_top = linalloc_top ();
+  cp->huft_size = huft_size;
+  memmove (cp->data, slide, WSIZE);
+  if (huft_size)
+    memmove (cp->data + WSIZE, (char *) linalloc_topaddr, huft_size);
+
+  checkpoints[num_checkpoints++] = cp;
+}
+
+/* Resume from the last checkpoint that lets gzip_filepos be read, if
+   it is further along than where the decoder is now (or will be after
+   a restart).  Return non-zero if one was used.  */
+static int
+restore_checkpoint (int restart)
+{
+  struct checkpoint *cp = 0;
+  int i;
+
+  for (i = 0; i < num_checkpoints; i++)
+    {
+      if (checkpoints[i]->out_pos > gzip_filepos + WSIZE)
+	break;
+      cp = checkpoints[i];
+    }
+
+  /* Skipping ahead of the data checked so far would leave the CRC
+     unverified.  */
+  if (! cp || cp->linalloc_top != linalloc_top ()
+      || (! restart && (cp->out_pos <= saved_filepos
+			|| (cp->out_pos > crc_pos && crc_pos < gzip_filemax))))
+    return 0;
+
+  saved_filepos = cp->out_pos;
+  filepos = cp->in_pos;
+  bufloc = inbuf_fill = INBUFSIZ;
+  bb = cp->bb;
+  bk = cp->bk;
+  block_type = cp->block_type;
+  block_len = cp->block_len;
+  last_block = cp->last_block;
+  code_state = cp->code_state;
+  inflate_n = cp->inflate_n;
+  inflate_d = cp->inflate_d;
+  tl = cp->tl;
+  td = cp->td;
+  bl = cp->bl;
+  bd = cp->bd;
+  linalloc_topaddr = cp->linalloc_topaddr;
+  if (cp->huft_size)
+    memmove ((char *) linalloc_topaddr, cp->data + WSIZE, cp->huft_size);
+  slide = prev_slide = window;
+  memmove (window, cp->data, WSIZE);
+
+  return 1;
 }
+#endif /* PLATFORM_EFI */
 
 
 static void
@@ -1175,6 +1683,8 @@ initialize_tables (void)
   /* initialize window, bit buffer */
   bk = 0;
   bb = 0;
+  bufloc = inbuf_fill = INBUFSIZ;
+  slide = prev_slide = window;
 
   /* reset partial decompression code */
   last_block = 0;
@@ -1185,11 +1695,32 @@ initialize_tables (void)
 }
 
 
+/* Release the memory held for the file just closed.  */
+void
+gunzip_close (void)
+{
+#ifdef PLATFORM_EFI
+  free_checkpoints ();
+  decomp_free ();
+  decompressor = 0;
+#endif
+}
+
 int
 gunzip_read (char *buf, int len)
 {
   int ret = 0;
 
+#ifdef PLATFORM_EFI
+  if (decompressor)
+    {
+      grub_memmove (buf, decomp_data + filepos, len);
+      filepos += len;
+      return len;
+    }
+#endif
+
+  bootstat_begin (BOOTSTAT_DECOMPRESS);
   compressed_file = 0;
   gunzip_swap_values ();
   /*
@@ -1197,8 +1728,18 @@ gunzip_read (char *buf, int len)
    */
 
   /* do we reset decompression to the beginning of the file? */
+#ifdef PLATFORM_EFI
+  if (saved_filepos > gzip_filepos + WSIZE)
+    {
+      if (! restore_checkpoint (1))
+	initialize_tables ();
+    }
+  else if (gzip_filepos > saved_filepos)
+    restore_checkpoint (0);
+#else
   if (saved_filepos > gzip_filepos + WSIZE)
     initialize_tables ();
+#endif
 
   /*
    *  This loop operates upon uncompressed data only.  The only
@@ -1211,8 +1752,30 @@ gunzip_read (char *buf, int len)
       register int size;
       register char *srcaddr;
 
+      /*
+       *  A whole window that the caller wants in full is decoded
+       *  directly into BUF, saving a copy through the sliding window.
+       */
+      if (gzip_filepos == saved_filepos && len >= WSIZE
+	  && memcheck ((unsigned long) buf, WSIZE))
+	{
+	  slide = (uch *) buf;
+	  inflate_window ();
+	  prev_slide = slide;
+
+	  buf += WSIZE;
+	  len -= WSIZE;
+	  gzip_filepos += WSIZE;
+	  ret += WSIZE;
+	  continue;
+	}
+
       while (gzip_filepos >= saved_filepos)
-	inflate_window ();
+	{
+	  slide = window;
+	  inflate_window ();
+	  prev_slide = slide;
+	}
 
       srcaddr = (char *) ((gzip_filepos & (WSIZE - 1)) + slide);
       size = saved_filepos - gzip_filepos;
@@ -1227,6 +1790,13 @@ gunzip_read (char *buf, int len)
       ret += size;
     }
 
+  /* The last window has to be kept for the next call.  */
+  if (slide != window)
+    {
+      memmove (window, slide, WSIZE);
+      slide = prev_slide = window;
+    }
+
   compressed_file = 1;
   gunzip_swap_values ();
   /*
@@ -1236,6 +1806,7 @@ gunzip_read (char *buf, int len)
   if (errnum)
     ret = 0;
 
+  bootstat_end (BOOTSTAT_DECOMPRESS, ret);
   return ret;
 }
 
@@ -286,6 +286,21 @@ sha256_process_bytes (const void *buffer, size_t len, struct sha256_ctx *ctx)
 }
 
 
+/* Compute the SHA256 digest of LEN bytes at BUFFER and write it to the
+   32 bytes at RESBUF, which need not be aligned.  */
+void
+sha256_digest (const void *buffer, unsigned int len, unsigned char *resbuf)
+{
+  struct sha256_ctx ctx;
+  uint32_t digest[8];
+
+  sha256_init_ctx (&ctx);
+  sha256_process_bytes (buffer, len, &ctx);
+  sha256_finish_ctx (&ctx, digest);
+  memcpy (resbuf, digest, sizeof (digest));
+}
+
+
 /* Define our magic string to mark salt for SHA256 "encryption"
    replacement.  */
 static const char sha256_salt_prefix[] = "$5$";
@@ -568,6 +568,7 @@ typedef enum
   ERR_DEV_NEED_INIT,
   ERR_NO_DISK_SPACE,
   ERR_NUMBER_OVERFLOW,
+  ERR_BAD_GZIP_CRC,
 
   MAX_ERR_NUM
 } grub_error_t;
@@ -644,10 +645,6 @@ extern int no_decompression;
 extern int compressed_file;
 #endif
 
-/* instrumentation variables */
-extern void (*disk_read_hook) (int, int, int);
-extern void (*disk_read_func) (int, int, int);
-
 #ifndef STAGE1_5
 /* The flag for debug mode.  */
 extern int debug;
@@ -666,6 +663,35 @@ extern unsigned long current_partition;
 
 extern int fsys_type;
 
+/* A sector number. EFI disks may have more sectors than fit in an int,
+   while the BIOS code and the Stage 1.5 keep the smaller type.  */
+#ifdef PLATFORM_EFI
+typedef long long grub_sector_t;
+#else
+typedef int grub_sector_t;
+#endif
+
+/* instrumentation variables */
+extern void (*disk_read_hook) (grub_sector_t, int, int);
+extern void (*disk_read_func) (grub_sector_t, int, int);
+
+/* The start or the length of a partition, read from a partition table.
+   GPT has 64-bit LBAs.  */
+#ifdef PLATFORM_EFI
+typedef unsigned long long grub_part_sector_t;
+#else
+typedef unsigned long grub_part_sector_t;
+#endif
+
+/* A file position or size. EFI can load files of more than 2GB.  */
+#ifdef PLATFORM_EFI
+typedef long long grub_filepos_t;
+# define MAX_FILEPOS	0x7FFFFFFFFFFFFFFFLL
+#else
+typedef int grub_filepos_t;
+# define MAX_FILEPOS	MAXINT
+#endif
+
 /* The information for a disk geometry. The CHS information is only for
    DOS/Partition table compatibility, and the real number of sectors is
    stored in TOTAL_SECTORS.  */
@@ -678,25 +704,55 @@ struct geometry
   /* The number of sectors */
   unsigned long sectors;
   /* The total number of sectors */
+#ifdef PLATFORM_EFI
+  unsigned long long total_sectors;
+#else
   unsigned long total_sectors;
+#endif
   /* Device sector size */
   unsigned long sector_size;
   /* Flags */
   unsigned long flags;
 };
 
-extern unsigned long part_start;
-extern unsigned long part_length;
+extern grub_part_sector_t part_start;
+extern grub_part_sector_t part_length;
 
 extern int current_slice;
 
 extern int buf_drive;
-extern int buf_track;
+extern grub_sector_t buf_track;
 extern struct geometry buf_geom;
 
+#ifdef PLATFORM_EFI
+/* The default size of the disk cache in kilobytes.  */
+#define DISK_CACHE_DEFAULT_SIZE	2048
+/* Reads of at least this many bytes bypass the disk cache and go
+   directly into the caller's buffer.  */
+#define DISK_DIRECT_READ_MIN	0x4000
+
+extern int disk_cache_size;
+extern unsigned long disk_cache_hits;
+extern unsigned long disk_cache_misses;
+
+/* TFTP block sizes: the RFC 1350 size, the largest that fits a 1500 byte
+   Ethernet frame, and the largest allowed by RFC 2348.  */
+#define TFTP_BLKSIZE_MIN	512
+#define TFTP_BLKSIZE_DEFAULT	1468
+#define TFTP_BLKSIZE_MAX	65464
+
+extern int tftp_blksize;
+
+/* Usage of the EFI heap, in bytes.  */
+extern unsigned long heap_size;
+extern unsigned long heap_used;
+extern unsigned long heap_peak;
+extern unsigned long heap_pool_allocs;
+#endif
+
 /* these are the current file position and maximum file position */
-extern int filepos;
-extern int filemax;
+extern grub_filepos_t filepos;
+extern grub_filepos_t filemax;
 
 extern int silent_grub;
 
@@ -845,10 +901,15 @@ keystatus (void);
 /* Low-level disk I/O */
 int get_diskinfo (int drive, struct geometry *geometry);
 int biosdisk (int subfunc, int drive, struct geometry *geometry,
-	      int sector, int nsec, int segment);
+	      grub_sector_t sector, int nsec, int segment);
 void stop_floppy (void);
 int get_sector_size (int drive);
 int get_sector_bits (int drive);
+#ifdef PLATFORM_EFI
+int efidisk_read (int drive, grub_sector_t sector, int nsec, char *buf);
+int efidisk_media_changed (int drive);
+void tftp_set_blksize (int size);
+#endif
 
 /* Command-line interface functions. */
 #ifndef STAGE1_5
@@ -980,12 +1041,60 @@ void grub_putstr (const char *str);
 /* Compression support. */
 int gunzip_test_header (void);
 int gunzip_read (char *buf, int len);
+void gunzip_close (void);
+#ifdef PLATFORM_EFI
+/* Helpers for the decompressors that work on the whole file.  */
+extern unsigned char *decomp_data;
+extern int decomp_size;
+int decomp_reserve (unsigned int len);
+int decomp_expect (unsigned long long size);
+#define DECOMP_GET_LE32(p) \
+  ((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((unsigned int) (p)[3] << 24))
+
+int unlz4_test (unsigned char *buf, int len);
+int unlz4_decode (const unsigned char *src, int size);
+int unxz_test (unsigned char *buf, int len);
+int unxz_decode (const unsigned char *src, int size);
+int unzstd_test (unsigned char *buf, int len);
+int unzstd_decode (const unsigned char *src, int size);
+#endif
 #endif /* NO_DECOMPRESSION */
 
-int rawread (int drive, int sector, int byte_offset, int byte_len, char *buf);
-int devread (int sector, int byte_offset, int byte_len, char *buf);
-int rawwrite (int drive, int sector, char *buf);
-int devwrite (int sector, int sector_len, char *buf);
+int rawread (int drive, grub_sector_t sector, int byte_offset, int byte_len,
+	     char *buf);
+int devread (grub_sector_t sector, int byte_offset, int byte_len, char *buf);
+int rawwrite (int drive, grub_sector_t sector, char *buf);
+int devwrite (grub_sector_t sector, int sector_len, char *buf);
+#ifdef PLATFORM_EFI
+void disk_cache_invalidate (void);
+void disk_cache_resize (int kbytes);
+#endif
+
+#ifdef PLATFORM_EFI
+/* The phases of booting timed by bootstat_begin and bootstat_end.  */
+#define BOOTSTAT_CONFIG		0
+#define BOOTSTAT_DISKS		1
+#define BOOTSTAT_MOUNT		2
+#define BOOTSTAT_KERNEL		3
+#define BOOTSTAT_INITRD		4
+#define BOOTSTAT_DECOMPRESS	5
+#define BOOTSTAT_DISK_READ	6
+#define BOOTSTAT_EXIT_BOOT_SERVICES	7
+#define BOOTSTAT_NUM		8
+
+/* The room kept at the end of the Linux command line for the timeline.  */
+#define BOOTSTAT_CMDLINE_MAX	256
+
+extern int bootstat_export;
+
+void bootstat_begin (int phase);
+void bootstat_end (int phase, unsigned long bytes);
+void bootstat_print (void);
+void bootstat_append_cmdline (char *cmdline, int size);
+#else
+# define bootstat_begin(phase)
+# define bootstat_end(phase, bytes)
+#endif
 
 /* Parse a device string and initialize the global parameters. */
 char *set_device (char *device);
@@ -994,11 +1103,22 @@ int real_open_partition (int flags);
 int open_partition (void);
 int next_partition (unsigned long drive, unsigned long dest,
 		    unsigned long *partition, int *type,
-		    unsigned long *start, unsigned long *len,
+		    grub_part_sector_t *start, grub_part_sector_t *len,
 		    unsigned long *offset, int *entry,
                    unsigned long *ext_offset,
-                   unsigned long *gpt_offset, int *gpt_count,
+                   grub_part_sector_t *gpt_offset, int *gpt_count,
                    int *gpt_size, char *buf);
+#ifdef PLATFORM_EFI
+int next_cached_partition (unsigned long drive, unsigned long dest,
+			   unsigned long *partition, int *type,
+			   grub_part_sector_t *start, grub_part_sector_t *len,
+			   unsigned long *offset, int *entry,
+			   unsigned long *ext_offset,
+			   grub_part_sector_t *gpt_offset, int *gpt_count,
+			   int *gpt_size, char *buf);
+#else
+# define next_cached_partition	next_partition
+#endif
 
 /* Sets device to the one represented by the SAVED_* parameters. */
 int make_saved_active (void);
@@ -1012,10 +1132,10 @@ int grub_open (char *filename);
 
 /* Read LEN bytes into BUF from the file that was opened with
    GRUB_OPEN.  If LEN is -1, read all the remaining data in the file.  */
-int grub_read (char *buf, int len);
+grub_filepos_t grub_read (char *buf, grub_filepos_t len);
 
 /* Reposition a file offset.  */
-int grub_seek (int offset);
+grub_filepos_t grub_seek (grub_filepos_t offset);
 
 /* Close a file.  */
 void grub_close (void);
@@ -1055,6 +1175,8 @@ int load_initrd (char *initrd);
 int check_password(char *entered, char* expected, password_t type);
 
 char *sha256_crypt (const char *key, const char *salt);
+void sha256_digest (const void *buffer, unsigned int len,
+		    unsigned char *resbuf);
 char *sha512_crypt (const char *key, const char *salt);
 #endif
 
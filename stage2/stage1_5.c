@@ -22,7 +22,7 @@
 static int saved_sector = -1;
 
 static void
-disk_read_savesect_func (int sector, int offset, int length)
+disk_read_savesect_func (grub_sector_t sector, int offset, int length)
 {
   saved_sector = sector;
 }
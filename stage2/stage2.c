@@ -95,6 +95,64 @@ get_entry (char *list, int num, int nested)
   return list;
 }
 
+/* Where each entry of the top-level menu starts. It is built once the
+   config file has been parsed, so that drawing or booting entry N does
+   not mean walking all of the entries before it. The extra element at
+   the end points at the terminating empty strings.  */
+struct menu_index
+{
+  char *title;
+  char *commands;
+};
+
+static struct menu_index *menu_index;
+static int menu_index_len;
+
+static void
+build_menu_index (char *menu_entries, char *config_entries, int num)
+{
+  int i;
+
+  for (i = 0; i < num; i++)
+    {
+      menu_index[i].title = menu_entries;
+      menu_index[i].commands = config_entries;
+
+      menu_entries += grub_strlen (menu_entries) + 1;
+      while (*config_entries)
+	config_entries += grub_strlen (config_entries) + 1;
+      config_entries++;
+    }
+
+  menu_index[i].title = menu_entries;
+  menu_index[i].commands = config_entries;
+  menu_index_len = num;
+}
+
+/* Return the title of entry NUM, from INDEX if the menu has one.  */
+static char *
+get_title (struct menu_index *index, char *menu_entries, int num)
+{
+  if (! index)
+    return get_entry (menu_entries, num, 0);
+
+  if (num > menu_index_len)
+    num = menu_index_len;
+  return index[num].title;
+}
+
+/* Return the commands of entry NUM, from INDEX if the menu has one.  */
+static char *
+get_commands (struct menu_index *index, char *config_entries, int num)
+{
+  if (! index)
+    return get_entry (config_entries, num, 1);
+
+  if (num > menu_index_len)
+    num = menu_index_len;
+  return index[num].commands;
+}
+
 /* Print an entry in a line of the menu box.  */
 static void
 print_entry (int y, int highlight, char *entry)
@@ -129,7 +187,8 @@ print_entry (int y, int highlight, char *entry)
 
 /* Print entries in the menu box.  */
 static void
-print_entries (int y, int size, int first, int entryno, char *menu_entries)
+print_entries (int y, int size, int first, int entryno, char *menu_entries,
+	       struct menu_index *index)
 {
   int i;
   
@@ -140,17 +199,28 @@ print_entries (int y, int size, int first, int entryno, char *menu_entries)
   else
     grub_putchar (' ');
 
-  menu_entries = get_entry (menu_entries, first, 0);
+  if (index)
+    {
+      for (i = 0; i < size; i++)
+	print_entry (y + i + 1, entryno == i,
+		     get_title (index, 0, first + i));
 
-  for (i = 0; i < size; i++)
+      menu_entries = get_title (index, 0, first + size);
+    }
+  else
     {
-      print_entry (y + i + 1, entryno == i, menu_entries);
+      menu_entries = get_entry (menu_entries, first, 0);
+
+      for (i = 0; i < size; i++)
+	{
+	  print_entry (y + i + 1, entryno == i, menu_entries);
 
-      while (*menu_entries)
-	menu_entries++;
+	  while (*menu_entries)
+	    menu_entries++;
 
-      if (*(menu_entries - 1))
-	menu_entries++;
+	  if (*(menu_entries - 1))
+	    menu_entries++;
+	}
     }
 
   gotoxy (77, y + size);
@@ -164,7 +234,8 @@ print_entries (int y, int size, int first, int entryno, char *menu_entries)
 }
 
 static void
-print_entries_raw (int size, int first, char *menu_entries)
+print_entries_raw (int size, int first, char *menu_entries,
+		   struct menu_index *index)
 {
   int i;
 
@@ -179,7 +250,7 @@ print_entries_raw (int size, int first, char *menu_entries)
       /* grub's printf can't %02d so ... */
       if (i < 10)
 	grub_putchar (' ');
-      grub_printf ("%d: %s\n", i, get_entry (menu_entries, i, 0));
+      grub_printf ("%d: %s\n", i, get_title (index, menu_entries, i));
     }
 
   for (i = 0; i < LINE_LENGTH; i++)
@@ -236,6 +307,9 @@ run_menu (char *menu_entries, char *config_entries, int num_entries,
   int c, time1, time2 = -1, first_entry = 0;
   char *cur_entry = 0;
   struct term_entry *prev_term = NULL;
+  /* Only the top-level menu is indexed; a command list being edited
+     changes under our feet.  */
+  struct menu_index *index = config_entries ? menu_index : 0;
 
   if (grub_verbose)
     cls();
@@ -310,7 +384,8 @@ restart:
 	      /* Print a message.  */
 	      if (print_message)
 		grub_printf ("\rBooting %s in %d seconds...",
-		             get_entry(menu_entries, first_entry + entryno, 0),
+		             get_title (index, menu_entries,
+					first_entry + entryno),
 		             grub_timeout);
 	    }
 	}
@@ -323,7 +398,7 @@ restart:
       setcursor (0);
 
       if (current_term->flags & TERM_DUMB)
-	print_entries_raw (num_entries, first_entry, menu_entries);
+	print_entries_raw (num_entries, first_entry, menu_entries, index);
       else
 	print_border (3, 12);
 
@@ -355,7 +430,7 @@ restart:
       if (current_term->flags & TERM_DUMB)
 	grub_printf ("\n\nThe selected entry is %d ", entryno);
       else
-	print_entries (3, 12, first_entry, entryno, menu_entries);
+	print_entries (3, 12, first_entry, entryno, menu_entries, index);
     }
 
   /* XX using RT clock now, need to initialize value */
@@ -433,20 +508,18 @@ restart:
 		  if (entryno > 0)
 		    {
 		      print_entry (4 + entryno, 0,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   get_title (index, menu_entries,
+					      first_entry + entryno));
 		      entryno--;
 		      print_entry (4 + entryno, 1,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   get_title (index, menu_entries,
+					      first_entry + entryno));
 		    }
 		  else if (first_entry > 0)
 		    {
 		      first_entry--;
 		      print_entries (3, 12, first_entry, entryno,
-				     menu_entries);
+				     menu_entries, index);
 		    }
 		}
 	    }
@@ -460,19 +533,18 @@ restart:
 		  if (entryno < 11)
 		    {
 		      print_entry (4 + entryno, 0,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   get_title (index, menu_entries,
+					      first_entry + entryno));
 		      entryno++;
 		      print_entry (4 + entryno, 1,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   get_title (index, menu_entries,
+					      first_entry + entryno));
 		  }
 		else if (num_entries > 12 + first_entry)
 		  {
 		    first_entry++;
-		    print_entries (3, 12, first_entry, entryno, menu_entries);
+		    print_entries (3, 12, first_entry, entryno,
+				   menu_entries, index);
 		  }
 		}
 	    }
@@ -487,7 +559,8 @@ restart:
 		  if (entryno < 0)
 		    entryno = 0;
 		}
-	      print_entries (3, 12, first_entry, entryno, menu_entries);
+	      print_entries (3, 12, first_entry, entryno,
+			     menu_entries, index);
 	    }
 	  else if (c == 3)
 	    {
@@ -500,7 +573,8 @@ restart:
 		    first_entry = 0;
 		  entryno = num_entries - first_entry - 1;
 		}
-	      print_entries (3, 12, first_entry, entryno, menu_entries);
+	      print_entries (3, 12, first_entry, entryno,
+			     menu_entries, index);
 	    }
 
 	  if (config_entries)
@@ -514,9 +588,8 @@ restart:
 		{
 		  if (! (current_term->flags & TERM_DUMB))
 		    print_entry (4 + entryno, 0,
-				 get_entry (menu_entries,
-					    first_entry + entryno,
-					    0));
+				 get_title (index, menu_entries,
+					    first_entry + entryno));
 
 		  /* insert after is almost exactly like insert before */
 		  if (c == 'o')
@@ -531,9 +604,8 @@ restart:
 		      c = 'O';
 		    }
 
-		  cur_entry = get_entry (menu_entries,
-					 first_entry + entryno,
-					 0);
+		  cur_entry = get_title (index, menu_entries,
+					 first_entry + entryno);
 
 		  if (c == 'O')
 		    {
@@ -549,9 +621,8 @@ restart:
 		    }
 		  else if (num_entries > 0)
 		    {
-		      char *ptr = get_entry(menu_entries,
-					    first_entry + entryno + 1,
-					    0);
+		      char *ptr = get_title (index, menu_entries,
+					     first_entry + entryno + 1);
 
 		      grub_memmove (cur_entry, ptr,
 				    heap - ptr);
@@ -569,11 +640,12 @@ restart:
 		    {
 		      grub_printf ("\n\n");
 		      print_entries_raw (num_entries, first_entry,
-					 menu_entries);
+					 menu_entries, index);
 		      grub_printf ("\n");
 		    }
 		  else
-		    print_entries (3, 12, first_entry, entryno, menu_entries);
+		    print_entries (3, 12, first_entry, entryno,
+				   menu_entries, index);
 		}
 
 	      cur_entry = menu_entries;
@@ -650,17 +722,15 @@ restart:
 		  if (config_entries)
 		    {
 		      new_heap = heap;
-		      cur_entry = get_entry (config_entries,
-					     first_entry + entryno,
-					     1);
+		      cur_entry = get_commands (index, config_entries,
+						first_entry + entryno);
 		    }
 		  else
 		    {
 		      /* safe area! */
 		      new_heap = heap + NEW_HEAPSIZE + 1;
-		      cur_entry = get_entry (menu_entries,
-					     first_entry + entryno,
-					     0);
+		      cur_entry = get_title (index, menu_entries,
+					     first_entry + entryno);
 		    }
 
 		  do
@@ -732,8 +802,8 @@ restart:
 		  char * start;
 
 		  entry_copy = new_heap = heap;
-		  cur_entry = get_entry (config_entries, first_entry + entryno,
-					 1);
+		  cur_entry = get_commands (index, config_entries,
+					    first_entry + entryno);
 		  
 		  do
 		    {
@@ -850,12 +920,13 @@ restart:
     {
       if (config_entries)
 	verbose_printf ("  Booting \'%s\'\n\n",
-		get_entry (menu_entries, first_entry + entryno, 0));
+		get_title (index, menu_entries, first_entry + entryno));
       else
 	verbose_printf ("  Booting command-list\n\n");
 
       if (! cur_entry)
-	cur_entry = get_entry (config_entries, first_entry + entryno, 1);
+	cur_entry = get_commands (index, config_entries,
+				  first_entry + entryno);
 
       /* Set CURRENT_ENTRYNO for the command "savedefault".  */
       current_entryno = first_entry + entryno;
@@ -891,25 +962,60 @@ restart:
 }
 
 
+/* The config file is read into CONFIG_BUF a block at a time, since
+   each call to grub_read goes all the way down to the filesystem code
+   and reading a byte per call made the parse slow for long files.  */
+#define CONFIG_BUFSIZE	0x1000
+
+static char config_buf[CONFIG_BUFSIZE];
+static int config_buf_pos;
+static int config_buf_len;
+
 static int
 get_line_from_config (char *cmdline, int maxlen, int read_from_file)
 {
   int pos = 0, literal = 0, comment = 0;
-  char c;  /* since we're loading it a byte at a time! */
+  char c;
   
   while (1)
     {
-      if (read_from_file)
+      if (config_buf_pos >= config_buf_len)
 	{
-	  if (! grub_read (&c, 1))
-	    break;
+	  if (read_from_file)
+	    config_buf_len = grub_read (config_buf, CONFIG_BUFSIZE);
+	  else
+	    config_buf_len = read_from_preset_menu (config_buf,
+						    CONFIG_BUFSIZE);
+
+	  config_buf_pos = 0;
+	  if (config_buf_len <= 0)
+	    {
+	      config_buf_len = 0;
+	      break;
+	    }
 	}
-      else
+
+      /* Skip the body of a comment line in one go, keeping track of
+	 a trailing backslash which continues the comment.  */
+      if (comment)
 	{
-	  if (! read_from_preset_menu (&c, 1))
-	    break;
+	  char *p = config_buf + config_buf_pos;
+	  char *end = config_buf + config_buf_len;
+
+	  while (p < end && *p != '\n')
+	    {
+	      if (*p != '\r')
+		literal = (*p == '\\');
+	      p++;
+	    }
+
+	  config_buf_pos = p - config_buf;
+	  if (p == end)
+	    continue;
 	}
 
+      c = config_buf[config_buf_pos++];
+
       /* Skip all carriage returns.  */
       if (c == '\r')
 	continue;
@@ -1027,9 +1133,12 @@ cmain (void)
 	      if (! is_opened)
 		break;
 
+	      bootstat_begin (BOOTSTAT_CONFIG);
+
 	      /* This is necessary, because the menu must be overrided.  */
 	      reset ();
 	      
+	      config_buf_pos = config_buf_len = 0;
 	      cmdline = (char *) CMDLINE_BUF;
 	      while (get_line_from_config (cmdline, NEW_HEAPSIZE,
 					   ! is_preset))
@@ -1150,6 +1259,8 @@ cmain (void)
 		    default_entry = 0;
 		}
 	      
+	      bootstat_end (BOOTSTAT_CONFIG, is_preset ? 0 : filemax);
+
 	      if (is_preset)
 		close_preset_menu ();
 	      else
@@ -1172,9 +1283,15 @@ cmain (void)
 	}
       else
 	{
+	  /* Index the entries, right after the menu; the heap follows.  */
+	  menu_index = (struct menu_index *)
+	    (((unsigned long) (menu_entries + menu_len)
+	      + sizeof (char *) - 1) & ~(sizeof (char *) - 1));
+	  build_menu_index (menu_entries, config_entries, num_entries);
+
 	  /* Run menu interface.  */
 	  run_menu (menu_entries, config_entries, num_entries,
-		    menu_entries + menu_len, default_entry);
+		    (char *) (menu_index + num_entries + 1), default_entry);
 	}
     }
 }
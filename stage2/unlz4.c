@@ -0,0 +1,391 @@
+/* unlz4.c - decompress LZ4 compressed files */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Both the LZ4 frame format and the older format used by Linux
+ * (lz4 -l) are understood.  Neither records the uncompressed size
+ * reliably, which GRUB needs to know when the file is opened, so
+ * gunzip.c hands us the whole file at that point and reads are served
+ * from the decompressed data.  LZ4 decompresses far faster than the
+ * file can be read, so this costs little beyond the memory, which is
+ * given back when the file is closed.  When a frame does record its
+ * size, exactly that much is allocated up front.
+ */
+
+#include "shared.h"
+#include "filesys.h"
+
+#if defined(PLATFORM_EFI) && !defined(NO_DECOMPRESSION)
+
+#include <grub/misc.h>
+
+#define LZ4_FRAME_MAGIC		0x184D2204
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_SKIPPABLE_MAGIC	0x184D2A50	/* low 4 bits vary */
+
+/* The largest block each format can produce.  */
+#define LZ4_LEGACY_BLOCK_MAX	(8 << 20)
+#define LZ4_FRAME_BLOCK_MAX	(4 << 20)
+
+/* Frame descriptor flags.  */
+#define LZ4_FLG_VERSION_MASK	0xC0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_BLOCK_CHECKSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICT_ID		0x01
+
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+
+/* xxHash32 primes */
+#define XXH_PRIME32_1		2654435761U
+#define XXH_PRIME32_2		2246822519U
+#define XXH_PRIME32_3		3266489917U
+#define XXH_PRIME32_4		668265263U
+#define XXH_PRIME32_5		374761393U
+
+static unsigned int
+rotl32 (unsigned int x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+/* The xxHash32 of LEN bytes at P with a seed of zero, which is what
+   the frame format uses for all of its checksums.  */
+static unsigned int
+xxh32 (const unsigned char *p, unsigned int len)
+{
+  const unsigned char *end = p + len;
+  unsigned int h;
+
+  if (len >= 16)
+    {
+      unsigned int v1 = XXH_PRIME32_1 + XXH_PRIME32_2;
+      unsigned int v2 = XXH_PRIME32_2;
+      unsigned int v3 = 0;
+      unsigned int v4 = - XXH_PRIME32_1;
+
+      do
+	{
+	  v1 = rotl32 (v1 + DECOMP_GET_LE32 (p) * XXH_PRIME32_2, 13) * XXH_PRIME32_1;
+	  v2 = rotl32 (v2 + DECOMP_GET_LE32 (p + 4) * XXH_PRIME32_2, 13)
+	    * XXH_PRIME32_1;
+	  v3 = rotl32 (v3 + DECOMP_GET_LE32 (p + 8) * XXH_PRIME32_2, 13)
+	    * XXH_PRIME32_1;
+	  v4 = rotl32 (v4 + DECOMP_GET_LE32 (p + 12) * XXH_PRIME32_2, 13)
+	    * XXH_PRIME32_1;
+	  p += 16;
+	}
+      while (end - p >= 16);
+
+      h = rotl32 (v1, 1) + rotl32 (v2, 7) + rotl32 (v3, 12) + rotl32 (v4, 18);
+    }
+  else
+    h = XXH_PRIME32_5;
+
+  h += len;
+
+  for (; end - p >= 4; p += 4)
+    h = rotl32 (h + DECOMP_GET_LE32 (p) * XXH_PRIME32_3, 17) * XXH_PRIME32_4;
+  for (; p < end; p++)
+    h = rotl32 (h + *p * XXH_PRIME32_5, 11) * XXH_PRIME32_1;
+
+  h ^= h >> 15;
+  h *= XXH_PRIME32_2;
+  h ^= h >> 13;
+  h *= XXH_PRIME32_3;
+  h ^= h >> 16;
+  return h;
+}
+
+/* Decompress one LZ4 block of LEN bytes at IP, appending at most MAX
+   bytes to the output.  Matches may refer back into earlier blocks.  */
+static int
+lz4_decode_block (const unsigned char *ip, int len, int max)
+{
+  const unsigned char *iend = ip + len;
+  unsigned char *op, *oend;
+
+  if (! decomp_reserve (max))
+    return 0;
+
+  op = decomp_data + decomp_size;
+  oend = op + max;
+
+  while (ip < iend)
+    {
+      unsigned int token = *ip++;
+      unsigned int length = token >> 4;
+      unsigned int offset;
+      const unsigned char *match;
+
+      /* literals */
+      if (length == 15)
+	{
+	  unsigned int b;
+
+	  do
+	    {
+	      if (ip >= iend)
+		goto fail;
+	      b = *ip++;
+	      length += b;
+	    }
+	  while (b == 255);
+	}
+
+      if (length > (unsigned int) (iend - ip)
+	  || length > (unsigned int) (oend - op))
+	goto fail;
+      grub_memmove (op, ip, length);
+      ip += length;
+      op += length;
+
+      /* the last sequence has no match */
+      if (ip == iend)
+	break;
+
+      /* match */
+      if (iend - ip < 2)
+	goto fail;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (unsigned int) (op - decomp_data))
+	goto fail;
+
+      length = token & 15;
+      if (length == 15)
+	{
+	  unsigned int b;
+
+	  do
+	    {
+	      if (ip >= iend)
+		goto fail;
+	      b = *ip++;
+	      length += b;
+	    }
+	  while (b == 255);
+	}
+      length += 4;
+
+      if (length > (unsigned int) (oend - op))
+	goto fail;
+
+      /* byte by byte, since the match may overlap its own output */
+      match = op - offset;
+      while (length--)
+	*op++ = *match++;
+    }
+
+  decomp_size = op - decomp_data;
+  return 1;
+
+ fail:
+  errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+/* Decode the frame starting at *PP, which must not go past END.  */
+static int
+lz4_decode_frame (const unsigned char **pp, const unsigned char *end)
+{
+  const unsigned char *p = *pp + 4;
+  unsigned int flg, block_max, desc_len;
+  unsigned long long content_size = 0;
+  int start = decomp_size;
+
+  if (end - p < 3)
+    goto fail;
+
+  flg = p[0];
+  if ((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION)
+    goto fail;
+
+  /* there is no way to hand us the dictionary */
+  if (flg & LZ4_FLG_DICT_ID)
+    goto fail;
+
+  block_max = 1 << (2 * ((p[1] >> 4) & 7) + 8);
+  if (block_max < 0x10000 || block_max > LZ4_FRAME_BLOCK_MAX)
+    goto fail;
+
+  /* FLG, BD and the optional content size, then the header checksum */
+  desc_len = 2;
+  if (flg & LZ4_FLG_CONTENT_SIZE)
+    desc_len += 8;
+  if ((unsigned int) (end - p) < desc_len + 1)
+    goto fail;
+
+  if (((xxh32 (p, desc_len) >> 8) & 0xFF) != p[desc_len])
+    {
+      errnum = ERR_BAD_GZIP_HEADER;
+      return 0;
+    }
+
+  if (flg & LZ4_FLG_CONTENT_SIZE)
+    {
+      content_size = DECOMP_GET_LE32 (p + 2)
+	| ((unsigned long long) DECOMP_GET_LE32 (p + 6) << 32);
+      if (! decomp_expect (content_size))
+	return 0;
+    }
+  p += desc_len + 1;
+
+  while (1)
+    {
+      unsigned int size, stored, max = block_max;
+
+      /* never make room for more than the frame says is left */
+      if ((flg & LZ4_FLG_CONTENT_SIZE)
+	  && content_size - (decomp_size - start) < max)
+	max = content_size - (decomp_size - start);
+
+      if (end - p < 4)
+	goto fail;
+      size = DECOMP_GET_LE32 (p);
+      p += 4;
+      if (size == 0)
+	break;
+
+      stored = size & ~LZ4_BLOCK_UNCOMPRESSED;
+      if (stored > (unsigned int) (end - p))
+	goto fail;
+
+      if (flg & LZ4_FLG_BLOCK_CHECKSUM)
+	{
+	  if ((unsigned int) (end - p) - stored < 4)
+	    goto fail;
+	  if (xxh32 (p, stored) != DECOMP_GET_LE32 (p + stored))
+	    {
+	      errnum = ERR_BAD_GZIP_CRC;
+	      return 0;
+	    }
+	}
+
+      if (size & LZ4_BLOCK_UNCOMPRESSED)
+	{
+	  if (stored > max || ! decomp_reserve (stored))
+	    goto fail;
+	  grub_memmove (decomp_data + decomp_size, p, stored);
+	  decomp_size += stored;
+	}
+      else if (! lz4_decode_block (p, stored, max))
+	return 0;
+
+      p += stored;
+      if (flg & LZ4_FLG_BLOCK_CHECKSUM)
+	p += 4;
+    }
+
+  if ((flg & LZ4_FLG_CONTENT_SIZE)
+      && content_size != (unsigned long long) (decomp_size - start))
+    goto fail;
+
+  if (flg & LZ4_FLG_CONTENT_CHECKSUM)
+    {
+      if (end - p < 4)
+	goto fail;
+      if (xxh32 (decomp_data + start, decomp_size - start) != DECOMP_GET_LE32 (p))
+	{
+	  errnum = ERR_BAD_GZIP_CRC;
+	  return 0;
+	}
+      p += 4;
+    }
+
+  *pp = p;
+  return 1;
+
+ fail:
+  if (! errnum)
+    errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+/* Decode the legacy format; it simply ends at the end of the data or
+   where another stream begins.  */
+static int
+lz4_decode_legacy (const unsigned char **pp, const unsigned char *end)
+{
+  const unsigned char *p = *pp + 4;
+
+  while (end - p >= 4)
+    {
+      unsigned int size = DECOMP_GET_LE32 (p);
+
+      if (size == LZ4_LEGACY_MAGIC || size == LZ4_FRAME_MAGIC)
+	break;
+
+      p += 4;
+      if (size > (unsigned int) (end - p))
+	{
+	  errnum = ERR_BAD_GZIP_DATA;
+	  return 0;
+	}
+
+      if (! lz4_decode_block (p, size, LZ4_LEGACY_BLOCK_MAX))
+	return 0;
+      p += size;
+    }
+
+  *pp = p;
+  return 1;
+}
+
+int
+unlz4_test (unsigned char *buf, int len)
+{
+  unsigned int magic;
+
+  if (len < 4)
+    return 0;
+
+  magic = DECOMP_GET_LE32 (buf);
+  return magic == LZ4_FRAME_MAGIC || magic == LZ4_LEGACY_MAGIC;
+}
+
+int
+unlz4_decode (const unsigned char *src, int size)
+{
+  const unsigned char *p = src;
+  const unsigned char *end = src + size;
+
+  /* a file may hold several streams, possibly of different kinds */
+  while (end - p >= 4 && ! errnum)
+    {
+      unsigned int magic = DECOMP_GET_LE32 (p);
+
+      if (magic == LZ4_FRAME_MAGIC)
+	lz4_decode_frame (&p, end);
+      else if (magic == LZ4_LEGACY_MAGIC)
+	lz4_decode_legacy (&p, end);
+      else if ((magic & 0xFFFFFFF0) == LZ4_SKIPPABLE_MAGIC
+	       && end - p >= 8
+	       && DECOMP_GET_LE32 (p + 4) <= (unsigned int) (end - p - 8))
+	p += 8 + DECOMP_GET_LE32 (p + 4);
+      else
+	break;
+    }
+
+  return ! errnum;
+}
+
+#endif /* PLATFORM_EFI && ! NO_DECOMPRESSION */
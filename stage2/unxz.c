@@ -0,0 +1,1059 @@
+/* unxz.c - decompress xz compressed files */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The xz container with LZMA2 data, optionally behind the x86 BCJ
+ * filter, which is what Linux uses for kernels and initrds.  As with
+ * LZ4, gunzip.c hands us the whole file when it is opened, since the
+ * uncompressed size is only recorded at the end of each stream.  The
+ * indexes there are read first, so the output is allocated once.  The
+ * block and index checks are verified; check types other than none,
+ * CRC32, CRC64 and SHA256 are refused, as are other filters.
+ */
+
+#include "shared.h"
+#include "filesys.h"
+
+#if defined(PLATFORM_EFI) && !defined(NO_DECOMPRESSION)
+
+#include <grub/misc.h>
+
+#define XZ_STREAM_HEADER_SIZE	12
+#define XZ_STREAM_FOOTER_SIZE	12
+
+static const unsigned char xz_header_magic[6] = { 0xFD, '7', 'z', 'X', 'Z', 0 };
+static const unsigned char xz_footer_magic[2] = { 'Y', 'Z' };
+
+#define XZ_CHECK_NONE		0
+#define XZ_CHECK_CRC32		1
+#define XZ_CHECK_CRC64		4
+#define XZ_CHECK_SHA256		10
+
+#define XZ_FILTER_X86		0x04
+#define XZ_FILTER_LZMA2		0x21
+
+/* Block flags.  */
+#define XZ_BLOCK_FILTERS_MASK	0x03
+#define XZ_BLOCK_RESERVED	0x3C
+#define XZ_BLOCK_COMPRESSED	0x40
+#define XZ_BLOCK_UNCOMPRESSED	0x80
+
+#define XZ_VLI_BYTES_MAX	9
+
+/* LZMA constants, named as in the LZMA SDK.  */
+#define LZMA_STATES		12
+#define LZMA_LIT_STATES		7
+#define LZMA_POS_STATES_MAX	16
+#define LZMA_LIT_SIZE		0x300
+#define LZMA_LCLP_MAX		4
+#define LZMA_DIST_STATES	4
+#define LZMA_DIST_SLOTS		64
+#define LZMA_DIST_MODEL_START	4
+#define LZMA_DIST_MODEL_END	14
+#define LZMA_FULL_DISTANCES	128
+#define LZMA_ALIGN_BITS		4
+#define LZMA_MATCH_LEN_MIN	2
+#define LZMA_LEN_LOW_SYMBOLS	8
+#define LZMA_LEN_MID_SYMBOLS	8
+#define LZMA_LEN_HIGH_SYMBOLS	256
+
+#define RC_TOP			(1 << 24)
+#define RC_BIT_MODEL_TOTAL_BITS	11
+#define RC_BIT_MODEL_TOTAL	(1 << RC_BIT_MODEL_TOTAL_BITS)
+#define RC_MOVE_BITS		5
+
+struct lzma_len_probs
+{
+  unsigned short choice;
+  unsigned short choice2;
+  unsigned short low[LZMA_POS_STATES_MAX][LZMA_LEN_LOW_SYMBOLS];
+  unsigned short mid[LZMA_POS_STATES_MAX][LZMA_LEN_MID_SYMBOLS];
+  unsigned short high[LZMA_LEN_HIGH_SYMBOLS];
+};
+
+/* Every probability, so that a state reset can simply fill them.  */
+struct lzma_probs
+{
+  unsigned short is_match[LZMA_STATES][LZMA_POS_STATES_MAX];
+  unsigned short is_rep[LZMA_STATES];
+  unsigned short is_rep0[LZMA_STATES];
+  unsigned short is_rep1[LZMA_STATES];
+  unsigned short is_rep2[LZMA_STATES];
+  unsigned short is_rep0_long[LZMA_STATES][LZMA_POS_STATES_MAX];
+  unsigned short dist_slot[LZMA_DIST_STATES][LZMA_DIST_SLOTS];
+  /* indexed from 1, as the reverse bit trees are */
+  unsigned short dist_special[LZMA_FULL_DISTANCES - LZMA_DIST_MODEL_END + 1];
+  unsigned short dist_align[1 << LZMA_ALIGN_BITS];
+  struct lzma_len_probs match_len;
+  struct lzma_len_probs rep_len;
+  unsigned short literal[LZMA_LIT_SIZE << LZMA_LCLP_MAX];
+};
+
+static struct
+{
+  /* range decoder */
+  const unsigned char *in;
+  const unsigned char *in_end;
+  unsigned int range;
+  unsigned int code;
+  int overrun;
+
+  unsigned int lc;
+  unsigned int lp_mask;
+  unsigned int pb_mask;
+
+  unsigned int state;
+  unsigned int rep0, rep1, rep2, rep3;
+
+  /* where the dictionary was last reset in the output, and how far back
+     matches may reach */
+  int dict_start;
+  unsigned int dict_size;
+
+  struct lzma_probs probs;
+} lzma;
+
+/* The sums of the block sizes, which the index must agree with.  */
+struct xz_index_sum
+{
+  unsigned long long count;
+  unsigned long long unpadded;
+  unsigned long long uncompressed;
+  unsigned int crc;
+};
+
+static unsigned int xz_crc32_table[256];
+static unsigned long long xz_crc64_table[256];
+
+static void
+xz_make_crc_tables (void)
+{
+  int n, k;
+
+  for (n = 0; n < 256; n++)
+    {
+      unsigned int c = n;
+      unsigned long long c64 = n;
+
+      for (k = 0; k < 8; k++)
+	{
+	  c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+	  c64 = c64 & 1 ? 0xC96C5795D7870F42ULL ^ (c64 >> 1) : c64 >> 1;
+	}
+      xz_crc32_table[n] = c;
+      xz_crc64_table[n] = c64;
+    }
+}
+
+static unsigned int
+xz_crc32 (const unsigned char *p, int len, unsigned int crc)
+{
+  if (! xz_crc32_table[1])
+    xz_make_crc_tables ();
+
+  crc = ~crc;
+  while (len--)
+    crc = xz_crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static unsigned long long
+xz_crc64 (const unsigned char *p, int len)
+{
+  unsigned long long crc = ~0ULL;
+
+  if (! xz_crc32_table[1])
+    xz_make_crc_tables ();
+
+  while (len--)
+    crc = xz_crc64_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+/* Read a variable-length integer at *PP, which must not go past END.  */
+static int
+xz_get_vli (const unsigned char **pp, const unsigned char *end,
+	    unsigned long long *val)
+{
+  const unsigned char *p = *pp;
+  int i;
+
+  *val = 0;
+  for (i = 0; i < XZ_VLI_BYTES_MAX && p < end; i++)
+    {
+      unsigned int b = *p++;
+
+      *val |= (unsigned long long) (b & 0x7F) << (7 * i);
+      if (! (b & 0x80))
+	{
+	  /* the encoding must be the shortest one */
+	  if (b == 0 && i > 0)
+	    return 0;
+	  *pp = p;
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+static void
+xz_index_add (struct xz_index_sum *sum, unsigned long long unpadded,
+	      unsigned long long uncompressed)
+{
+  unsigned char rec[16];
+  int i;
+
+  for (i = 0; i < 8; i++)
+    {
+      rec[i] = unpadded >> (8 * i);
+      rec[8 + i] = uncompressed >> (8 * i);
+    }
+
+  sum->count++;
+  sum->unpadded += unpadded;
+  sum->uncompressed += uncompressed;
+  sum->crc = xz_crc32 (rec, sizeof (rec), sum->crc);
+}
+
+static void
+rc_normalize (void)
+{
+  if (lzma.range < RC_TOP)
+    {
+      lzma.range <<= 8;
+      lzma.code <<= 8;
+      if (lzma.in < lzma.in_end)
+	lzma.code |= *lzma.in++;
+      else
+	lzma.overrun = 1;
+    }
+}
+
+static unsigned int
+rc_bit (unsigned short *prob)
+{
+  unsigned int bound;
+
+  rc_normalize ();
+  bound = (lzma.range >> RC_BIT_MODEL_TOTAL_BITS) * *prob;
+  if (lzma.code < bound)
+    {
+      lzma.range = bound;
+      *prob += (RC_BIT_MODEL_TOTAL - *prob) >> RC_MOVE_BITS;
+      return 0;
+    }
+
+  lzma.range -= bound;
+  lzma.code -= bound;
+  *prob -= *prob >> RC_MOVE_BITS;
+  return 1;
+}
+
+/* Decode a symbol from the bit tree at PROBS, returning it with the
+   leading one bit, i.e. between LIMIT and 2 * LIMIT - 1.  */
+static unsigned int
+rc_bittree (unsigned short *probs, unsigned int limit)
+{
+  unsigned int symbol = 1;
+
+  do
+    symbol = (symbol << 1) + rc_bit (&probs[symbol]);
+  while (symbol < limit);
+
+  return symbol;
+}
+
+static unsigned int
+rc_bittree_reverse (unsigned short *probs, int bits)
+{
+  unsigned int symbol = 1, result = 0;
+  int i;
+
+  for (i = 0; i < bits; i++)
+    {
+      unsigned int bit = rc_bit (&probs[symbol]);
+
+      symbol = (symbol << 1) + bit;
+      result |= bit << i;
+    }
+
+  return result;
+}
+
+static unsigned int
+rc_direct (int bits)
+{
+  unsigned int result = 0;
+
+  while (bits--)
+    {
+      unsigned int mask;
+
+      rc_normalize ();
+      lzma.range >>= 1;
+      lzma.code -= lzma.range;
+      mask = 0 - (lzma.code >> 31);
+      lzma.code += lzma.range & mask;
+      result = (result << 1) + mask + 1;
+    }
+
+  return result;
+}
+
+static void
+lzma_reset (void)
+{
+  unsigned short *prob = (unsigned short *) &lzma.probs;
+  unsigned int i;
+
+  for (i = 0; i < sizeof (lzma.probs) / sizeof (*prob); i++)
+    prob[i] = RC_BIT_MODEL_TOTAL / 2;
+
+  lzma.state = 0;
+  lzma.rep0 = lzma.rep1 = lzma.rep2 = lzma.rep3 = 0;
+}
+
+static int
+lzma_props (unsigned int props)
+{
+  unsigned int lc, lp, pb;
+
+  if (props >= 9 * 5 * 5)
+    return 0;
+
+  lc = props % 9;
+  props /= 9;
+  lp = props % 5;
+  pb = props / 5;
+  if (lc + lp > LZMA_LCLP_MAX)
+    return 0;
+
+  lzma.lc = lc;
+  lzma.lp_mask = (1 << lp) - 1;
+  lzma.pb_mask = (1 << pb) - 1;
+  return 1;
+}
+
+static unsigned int
+lzma_len (struct lzma_len_probs *probs, unsigned int pos_state)
+{
+  if (! rc_bit (&probs->choice))
+    return LZMA_MATCH_LEN_MIN
+      + rc_bittree (probs->low[pos_state], LZMA_LEN_LOW_SYMBOLS)
+      - LZMA_LEN_LOW_SYMBOLS;
+
+  if (! rc_bit (&probs->choice2))
+    return LZMA_MATCH_LEN_MIN + LZMA_LEN_LOW_SYMBOLS
+      + rc_bittree (probs->mid[pos_state], LZMA_LEN_MID_SYMBOLS)
+      - LZMA_LEN_MID_SYMBOLS;
+
+  return LZMA_MATCH_LEN_MIN + LZMA_LEN_LOW_SYMBOLS + LZMA_LEN_MID_SYMBOLS
+    + rc_bittree (probs->high, LZMA_LEN_HIGH_SYMBOLS)
+    - LZMA_LEN_HIGH_SYMBOLS;
+}
+
+/* Decode the distance of a match of length LEN, less one.  */
+static unsigned int
+lzma_dist (unsigned int len)
+{
+  unsigned int dist_state, slot, bits, dist;
+
+  dist_state = len - LZMA_MATCH_LEN_MIN;
+  if (dist_state >= LZMA_DIST_STATES)
+    dist_state = LZMA_DIST_STATES - 1;
+
+  slot = rc_bittree (lzma.probs.dist_slot[dist_state], LZMA_DIST_SLOTS)
+    - LZMA_DIST_SLOTS;
+  if (slot < LZMA_DIST_MODEL_START)
+    return slot;
+
+  bits = (slot >> 1) - 1;
+  dist = (2 | (slot & 1)) << bits;
+  if (slot < LZMA_DIST_MODEL_END)
+    return dist + rc_bittree_reverse (lzma.probs.dist_special + dist - slot,
+				      bits);
+
+  dist += rc_direct (bits - LZMA_ALIGN_BITS) << LZMA_ALIGN_BITS;
+  return dist + rc_bittree_reverse (lzma.probs.dist_align, LZMA_ALIGN_BITS);
+}
+
+/* Decode one LZMA chunk of IN_LEN bytes at IN into OUT_LEN bytes of
+   output.  Matches may not run on into the next chunk.  */
+static int
+lzma_decode_chunk (const unsigned char *in, unsigned int in_len,
+		   unsigned int out_len)
+{
+  unsigned char *out, *out_end;
+
+  if (in_len < 5 || in[0] != 0 || ! decomp_reserve (out_len))
+    goto fail;
+
+  lzma.in = in + 5;
+  lzma.in_end = in + in_len;
+  lzma.range = 0xFFFFFFFF;
+  lzma.code = ((unsigned int) in[1] << 24) | (in[2] << 16) | (in[3] << 8)
+    | in[4];
+  lzma.overrun = 0;
+
+  out = decomp_data + decomp_size;
+  out_end = out + out_len;
+
+  while (out < out_end)
+    {
+      unsigned int pos = out - (decomp_data + lzma.dict_start);
+      unsigned int pos_state = pos & lzma.pb_mask;
+      unsigned int len;
+      unsigned char *match;
+
+      if (! rc_bit (&lzma.probs.is_match[lzma.state][pos_state]))
+	{
+	  unsigned int prev = pos ? out[-1] : 0;
+	  unsigned short *probs;
+	  unsigned int symbol;
+
+	  probs = lzma.probs.literal
+	    + LZMA_LIT_SIZE * (((pos & lzma.lp_mask) << lzma.lc)
+			       + (prev >> (8 - lzma.lc)));
+
+	  if (lzma.state < LZMA_LIT_STATES)
+	    symbol = rc_bittree (probs, 0x100);
+	  else
+	    {
+	      /* the state says a match was just decoded, so rep0 is
+		 known to be within the dictionary */
+	      unsigned int match_byte = out[- (int) lzma.rep0 - 1];
+
+	      symbol = 1;
+	      do
+		{
+		  unsigned int match_bit = (match_byte >> 7) & 1;
+		  unsigned int bit;
+
+		  match_byte <<= 1;
+		  bit = rc_bit (&probs[((1 + match_bit) << 8) + symbol]);
+		  symbol = (symbol << 1) | bit;
+		  if (bit != match_bit)
+		    break;
+		}
+	      while (symbol < 0x100);
+
+	      while (symbol < 0x100)
+		symbol = (symbol << 1) | rc_bit (&probs[symbol]);
+	    }
+
+	  *out++ = symbol;
+	  if (lzma.state < 4)
+	    lzma.state = 0;
+	  else if (lzma.state < 10)
+	    lzma.state -= 3;
+	  else
+	    lzma.state -= 6;
+	  continue;
+	}
+
+      if (! rc_bit (&lzma.probs.is_rep[lzma.state]))
+	{
+	  lzma.rep3 = lzma.rep2;
+	  lzma.rep2 = lzma.rep1;
+	  lzma.rep1 = lzma.rep0;
+	  len = lzma_len (&lzma.probs.match_len, pos_state);
+	  lzma.state = lzma.state < LZMA_LIT_STATES ? 7 : 10;
+	  lzma.rep0 = lzma_dist (len);
+	}
+      else if (! rc_bit (&lzma.probs.is_rep0[lzma.state]))
+	{
+	  if (! rc_bit (&lzma.probs.is_rep0_long[lzma.state][pos_state]))
+	    {
+	      /* a single byte at rep0 */
+	      lzma.state = lzma.state < LZMA_LIT_STATES ? 9 : 11;
+	      len = 1;
+	    }
+	  else
+	    {
+	      len = lzma_len (&lzma.probs.rep_len, pos_state);
+	      lzma.state = lzma.state < LZMA_LIT_STATES ? 8 : 11;
+	    }
+	}
+      else
+	{
+	  unsigned int dist;
+
+	  if (! rc_bit (&lzma.probs.is_rep1[lzma.state]))
+	    dist = lzma.rep1;
+	  else
+	    {
+	      if (! rc_bit (&lzma.probs.is_rep2[lzma.state]))
+		dist = lzma.rep2;
+	      else
+		{
+		  dist = lzma.rep3;
+		  lzma.rep3 = lzma.rep2;
+		}
+	      lzma.rep2 = lzma.rep1;
+	    }
+	  lzma.rep1 = lzma.rep0;
+	  lzma.rep0 = dist;
+
+	  len = lzma_len (&lzma.probs.rep_len, pos_state);
+	  lzma.state = lzma.state < LZMA_LIT_STATES ? 8 : 11;
+	}
+
+      /* this also catches the end marker, which LZMA2 does not use */
+      if (lzma.rep0 >= pos || lzma.rep0 >= lzma.dict_size
+	  || len > (unsigned int) (out_end - out))
+	goto fail;
+
+      match = out - lzma.rep0 - 1;
+      while (len--)
+	*out++ = *match++;
+    }
+
+  /* the encoder flushes the range coder in full, so the chunk ends
+     exactly where a normalized decoder does */
+  rc_normalize ();
+  if (lzma.overrun || lzma.in != lzma.in_end || lzma.code != 0)
+    goto fail;
+
+  decomp_size += out_len;
+  return 1;
+
+ fail:
+  if (! errnum)
+    errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+/* Decode the LZMA2 data at *PP, which must not go past END.  */
+static int
+lzma2_decode (const unsigned char **pp, const unsigned char *end)
+{
+  const unsigned char *p = *pp;
+  int need_dict_reset = 1;
+  int need_props = 1;
+
+  while (1)
+    {
+      unsigned int control, out_len, in_len;
+
+      if (p >= end)
+	goto fail;
+      control = *p++;
+      if (control == 0)
+	break;
+
+      /* 1 is an uncompressed chunk and 0xE0 and up LZMA chunks that
+	 reset the dictionary; the first chunk must be one of those */
+      if (control >= 0xE0 || control == 1)
+	{
+	  need_props = 1;
+	  need_dict_reset = 0;
+	  lzma.dict_start = decomp_size;
+	}
+      else if (need_dict_reset)
+	goto fail;
+
+      if (control >= 0x80)
+	{
+	  if (end - p < 4)
+	    goto fail;
+	  out_len = ((control & 0x1F) << 16) + (p[0] << 8) + p[1] + 1;
+	  in_len = (p[2] << 8) + p[3] + 1;
+	  p += 4;
+
+	  /* 0xC0 and up carry new properties, which also reset the
+	     state, and 0xA0 and up reset only the state */
+	  if (control >= 0xC0)
+	    {
+	      if (p >= end || ! lzma_props (*p++))
+		goto fail;
+	      need_props = 0;
+	      lzma_reset ();
+	    }
+	  else if (need_props)
+	    goto fail;
+	  else if (control >= 0xA0)
+	    lzma_reset ();
+
+	  if (in_len > (unsigned int) (end - p)
+	      || ! lzma_decode_chunk (p, in_len, out_len))
+	    goto fail;
+	  p += in_len;
+	}
+      else
+	{
+	  if (control > 2 || end - p < 2)
+	    goto fail;
+	  out_len = (p[0] << 8) + p[1] + 1;
+	  p += 2;
+
+	  if (out_len > (unsigned int) (end - p) || ! decomp_reserve (out_len))
+	    goto fail;
+	  grub_memmove (decomp_data + decomp_size, p, out_len);
+	  decomp_size += out_len;
+	  p += out_len;
+	}
+    }
+
+  *pp = p;
+  return 1;
+
+ fail:
+  if (! errnum)
+    errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+#define x86_ms_byte(b)	((b) == 0 || (b) == 0xFF)
+
+/* Undo the x86 BCJ filter, which turns the relative addresses of CALL
+   and JMP instructions into absolute ones, on the LEN bytes at BUF
+   that start at offset POS of the filtered data.  The last four bytes
+   are never converted.  */
+static void
+bcj_x86 (unsigned char *buf, unsigned int len, unsigned int pos)
+{
+  static const int mask_allowed[8] = { 1, 1, 1, 0, 1, 0, 0, 0 };
+  static const int mask_bit[8] = { 0, 1, 2, 2, 3, 3, 3, 3 };
+  unsigned int prev_mask = 0;
+  unsigned int prev_pos = pos - 5;
+  unsigned int i;
+
+  if (len < 5)
+    return;
+
+  for (i = 0; i <= len - 5; i++)
+    {
+      unsigned int offset, b;
+
+      if (buf[i] != 0xE8 && buf[i] != 0xE9)
+	continue;
+
+      offset = pos + i - prev_pos;
+      prev_pos = pos + i;
+      if (offset > 5)
+	prev_mask = 0;
+      else
+	while (offset--)
+	  prev_mask = (prev_mask & 0x77) << 1;
+
+      b = buf[i + 4];
+      if (x86_ms_byte (b) && mask_allowed[(prev_mask >> 1) & 7]
+	  && (prev_mask >> 1) < 0x10)
+	{
+	  unsigned int src = DECOMP_GET_LE32 (buf + i + 1);
+	  unsigned int dest;
+
+	  while (1)
+	    {
+	      unsigned int n;
+
+	      dest = src - (pos + i + 5);
+	      if (prev_mask == 0)
+		break;
+	      n = mask_bit[prev_mask >> 1];
+	      b = (dest >> (24 - n * 8)) & 0xFF;
+	      if (! x86_ms_byte (b))
+		break;
+	      src = dest ^ ((1U << (32 - n * 8)) - 1);
+	    }
+
+	  buf[i + 4] = ~(((dest >> 24) & 1) - 1);
+	  buf[i + 3] = dest >> 16;
+	  buf[i + 2] = dest >> 8;
+	  buf[i + 1] = dest;
+	  i += 4;
+	  prev_mask = 0;
+	}
+      else
+	{
+	  prev_mask |= 1;
+	  if (x86_ms_byte (b))
+	    prev_mask |= 0x10;
+	}
+    }
+}
+
+static int
+xz_check_size (int check)
+{
+  switch (check)
+    {
+    case XZ_CHECK_NONE:
+      return 0;
+    case XZ_CHECK_CRC32:
+      return 4;
+    case XZ_CHECK_CRC64:
+      return 8;
+    case XZ_CHECK_SHA256:
+      return 32;
+    }
+
+  return -1;
+}
+
+/* Check the LEN bytes of output at DATA against the CHECK at P.  */
+static int
+xz_verify (int check, const unsigned char *data, int len,
+	   const unsigned char *p)
+{
+  unsigned char digest[32];
+  unsigned long long crc64;
+  int i;
+
+  switch (check)
+    {
+    case XZ_CHECK_CRC32:
+      return xz_crc32 (data, len, 0) == DECOMP_GET_LE32 (p);
+
+    case XZ_CHECK_CRC64:
+      crc64 = xz_crc64 (data, len);
+      for (i = 0; i < 8; i++)
+	if (p[i] != ((crc64 >> (8 * i)) & 0xFF))
+	  return 0;
+      return 1;
+
+    case XZ_CHECK_SHA256:
+      sha256_digest (data, len, digest);
+      return grub_memcmp ((char *) digest, (char *) p, sizeof (digest)) == 0;
+    }
+
+  return 1;
+}
+
+/* Decode the block starting at *PP, which must not go past END, and
+   add its sizes to SUM.  */
+static int
+xz_decode_block (const unsigned char **pp, const unsigned char *end,
+		 int check, struct xz_index_sum *sum)
+{
+  const unsigned char *start = *pp;
+  const unsigned char *p, *hend, *data, *data_end;
+  unsigned long long comp_size = 0, uncomp_size = 0, id, size;
+  unsigned int header_len, flags, dict = 0, in_len, out_len;
+  int filters, i, x86 = 0, check_len = xz_check_size (check);
+  unsigned int x86_start = 0;
+  int out_start = decomp_size;
+
+  header_len = (start[0] + 1) * 4;
+  if ((unsigned int) (end - start) < header_len)
+    goto fail;
+  hend = start + header_len - 4;
+  if (xz_crc32 (start, header_len - 4, 0) != DECOMP_GET_LE32 (hend))
+    {
+      errnum = ERR_BAD_GZIP_CRC;
+      return 0;
+    }
+
+  flags = start[1];
+  if (flags & XZ_BLOCK_RESERVED)
+    goto bad_header;
+  p = start + 2;
+  if ((flags & XZ_BLOCK_COMPRESSED) && ! xz_get_vli (&p, hend, &comp_size))
+    goto bad_header;
+  if ((flags & XZ_BLOCK_UNCOMPRESSED)
+      && ! xz_get_vli (&p, hend, &uncomp_size))
+    goto bad_header;
+
+  /* an optional x86 filter and then LZMA2, which must come last */
+  filters = (flags & XZ_BLOCK_FILTERS_MASK) + 1;
+  for (i = 0; i < filters; i++)
+    {
+      if (! xz_get_vli (&p, hend, &id) || ! xz_get_vli (&p, hend, &size)
+	  || size > (unsigned long long) (hend - p))
+	goto bad_header;
+
+      if (i == filters - 1)
+	{
+	  if (id != XZ_FILTER_LZMA2 || size != 1)
+	    goto bad_header;
+	  dict = *p++;
+	}
+      else if (id == XZ_FILTER_X86 && ! x86 && (size == 0 || size == 4))
+	{
+	  x86 = 1;
+	  if (size == 4)
+	    x86_start = DECOMP_GET_LE32 (p);
+	  p += size;
+	}
+      else
+	goto bad_header;
+    }
+
+  /* the rest of the header is padding */
+  while (p < hend)
+    if (*p++)
+      goto bad_header;
+
+  if (dict > 40)
+    goto bad_header;
+  lzma.dict_size = dict == 40 ? 0xFFFFFFFF : (2 | (dict & 1)) << (dict / 2 + 11);
+
+  p = data = hend + 4;
+  data_end = end;
+  if (flags & XZ_BLOCK_COMPRESSED)
+    {
+      if (comp_size > (unsigned long long) (end - p))
+	goto fail;
+      data_end = p + comp_size;
+    }
+
+  if (! lzma2_decode (&p, data_end))
+    return 0;
+
+  in_len = p - data;
+  out_len = decomp_size - out_start;
+  if (((flags & XZ_BLOCK_COMPRESSED) && p != data_end)
+      || ((flags & XZ_BLOCK_UNCOMPRESSED) && out_len != uncomp_size))
+    goto fail;
+
+  if (x86)
+    bcj_x86 (decomp_data + out_start, out_len, x86_start);
+
+  /* the block padding, which is not part of the compressed size, and
+     the check */
+  while ((p - start) & 3)
+    if (p >= end || *p++)
+      goto fail;
+  if (end - p < check_len)
+    goto fail;
+  if (! xz_verify (check, decomp_data + out_start, out_len, p))
+    {
+      errnum = ERR_BAD_GZIP_CRC;
+      return 0;
+    }
+  p += check_len;
+
+  xz_index_add (sum, (unsigned long long) header_len + in_len + check_len,
+		out_len);
+  *pp = p;
+  return 1;
+
+ bad_header:
+  errnum = ERR_BAD_GZIP_HEADER;
+  return 0;
+
+ fail:
+  if (! errnum)
+    errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+/* Decode the index at *PP, which must not go past END, and check that
+   it describes the blocks added up in SUM.  */
+static int
+xz_decode_index (const unsigned char **pp, const unsigned char *end,
+		 struct xz_index_sum *sum)
+{
+  const unsigned char *start = *pp;
+  const unsigned char *p = start + 1;
+  struct xz_index_sum index;
+  unsigned long long count, unpadded, uncompressed;
+
+  grub_memset (&index, 0, sizeof (index));
+  if (! xz_get_vli (&p, end, &count))
+    goto fail;
+
+  while (count--)
+    {
+      if (! xz_get_vli (&p, end, &unpadded)
+	  || ! xz_get_vli (&p, end, &uncompressed))
+	goto fail;
+      xz_index_add (&index, unpadded, uncompressed);
+    }
+
+  while ((p - start) & 3)
+    if (p >= end || *p++)
+      goto fail;
+  if (end - p < 4)
+    goto fail;
+  if (xz_crc32 (start, p - start, 0) != DECOMP_GET_LE32 (p))
+    {
+      errnum = ERR_BAD_GZIP_CRC;
+      return 0;
+    }
+  p += 4;
+
+  if (index.count != sum->count || index.unpadded != sum->unpadded
+      || index.uncompressed != sum->uncompressed || index.crc != sum->crc)
+    goto fail;
+
+  *pp = p;
+  return 1;
+
+ fail:
+  errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+/* Decode the stream starting at *PP, which must not go past END.  */
+static int
+xz_decode_stream (const unsigned char **pp, const unsigned char *end)
+{
+  const unsigned char *header = *pp;
+  const unsigned char *p, *index;
+  struct xz_index_sum sum;
+  int check;
+
+  if (end - header < XZ_STREAM_HEADER_SIZE)
+    goto fail;
+  if (header[6] != 0 || (header[7] & 0xF0))
+    goto bad_header;
+  if (xz_crc32 (header + 6, 2, 0) != DECOMP_GET_LE32 (header + 8))
+    goto bad_crc;
+
+  check = header[7];
+  if (xz_check_size (check) < 0)
+    goto bad_header;
+
+  grub_memset (&sum, 0, sizeof (sum));
+  p = header + XZ_STREAM_HEADER_SIZE;
+  while (1)
+    {
+      if (p >= end)
+	goto fail;
+      /* a zero header size marks the index */
+      if (*p == 0)
+	break;
+      if (! xz_decode_block (&p, end, check, &sum))
+	return 0;
+    }
+
+  index = p;
+  if (! xz_decode_index (&p, end, &sum))
+    return 0;
+
+  /* the footer repeats the flags and records the size of the index */
+  if (end - p < XZ_STREAM_FOOTER_SIZE)
+    goto fail;
+  if (xz_crc32 (p + 4, 6, 0) != DECOMP_GET_LE32 (p))
+    goto bad_crc;
+  if ((DECOMP_GET_LE32 (p + 4) + 1ULL) * 4 != (unsigned long long) (p - index)
+      || p[8] != header[6] || p[9] != header[7]
+      || grub_memcmp ((char *) p + 10, (char *) xz_footer_magic,
+		      sizeof (xz_footer_magic)) != 0)
+    goto fail;
+
+  *pp = p + XZ_STREAM_FOOTER_SIZE;
+  return 1;
+
+ bad_header:
+  errnum = ERR_BAD_GZIP_HEADER;
+  return 0;
+
+ bad_crc:
+  errnum = ERR_BAD_GZIP_CRC;
+  return 0;
+
+ fail:
+  errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+/* Add up the uncompressed sizes recorded in the indexes of the streams
+   between START and END, walking back from the footer of the last one,
+   so that the output can be allocated in one go.  */
+static int
+xz_indexed_size (const unsigned char *start, const unsigned char *end,
+		 unsigned long long *total)
+{
+  *total = 0;
+  while (end > start)
+    {
+      const unsigned char *footer, *index, *p;
+      unsigned long long count, unpadded, uncompressed, blocks = 0;
+      unsigned long long index_size;
+
+      /* stream padding */
+      if (end - start >= 4 && DECOMP_GET_LE32 (end - 4) == 0)
+	{
+	  end -= 4;
+	  continue;
+	}
+
+      if (end - start < XZ_STREAM_HEADER_SIZE + XZ_STREAM_FOOTER_SIZE)
+	return 0;
+      footer = end - XZ_STREAM_FOOTER_SIZE;
+      if (grub_memcmp ((char *) footer + 10, (char *) xz_footer_magic,
+		       sizeof (xz_footer_magic)) != 0
+	  || xz_crc32 (footer + 4, 6, 0) != DECOMP_GET_LE32 (footer))
+	return 0;
+
+      index_size = (DECOMP_GET_LE32 (footer + 4) + 1ULL) * 4;
+      if (index_size > (unsigned long long) (footer - start
+					     - XZ_STREAM_HEADER_SIZE))
+	return 0;
+      index = footer - index_size;
+
+      p = index + 1;
+      if (*index != 0 || ! xz_get_vli (&p, footer, &count))
+	return 0;
+      while (count--)
+	{
+	  if (! xz_get_vli (&p, footer, &unpadded)
+	      || ! xz_get_vli (&p, footer, &uncompressed))
+	    return 0;
+	  blocks += (unpadded + 3) & ~3ULL;
+	  *total += uncompressed;
+	}
+
+      if (blocks > (unsigned long long) (index - start
+					 - XZ_STREAM_HEADER_SIZE))
+	return 0;
+      end = index - blocks - XZ_STREAM_HEADER_SIZE;
+    }
+
+  return 1;
+}
+
+int
+unxz_test (unsigned char *buf, int len)
+{
+  return len >= (int) sizeof (xz_header_magic)
+    && grub_memcmp ((char *) buf, (char *) xz_header_magic,
+		    sizeof (xz_header_magic)) == 0;
+}
+
+int
+unxz_decode (const unsigned char *src, int size)
+{
+  const unsigned char *p = src;
+  const unsigned char *end = src + size;
+  unsigned long long total;
+
+  /* if the indexes cannot be made sense of, decoding will say why */
+  if (xz_indexed_size (src, end, &total) && ! decomp_expect (total))
+    return 0;
+
+  /* streams may be concatenated, with zero padding between them */
+  while (xz_decode_stream (&p, end))
+    {
+      while (end - p >= 4 && DECOMP_GET_LE32 (p) == 0)
+	p += 4;
+      if (end - p < (int) sizeof (xz_header_magic)
+	  || grub_memcmp ((char *) p, (char *) xz_header_magic,
+			  sizeof (xz_header_magic)) != 0)
+	break;
+    }
+
+  return ! errnum;
+}
+
+#endif /* PLATFORM_EFI && ! NO_DECOMPRESSION */
@@ -0,0 +1,1081 @@
+/* unzstd.c - decompress zstd compressed files */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2026  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Zstandard frames as described in RFC 8878, without dictionaries.  As
+ * with LZ4, gunzip.c hands us the whole file when it is opened, since
+ * the content size need not be recorded; when a frame does record it,
+ * exactly that much is allocated.  The content checksum is verified
+ * when the frame has one.
+ */
+
+#include "shared.h"
+#include "filesys.h"
+
+#if defined(PLATFORM_EFI) && !defined(NO_DECOMPRESSION)
+
+#include <grub/misc.h>
+
+#define ZSTD_MAGIC		0xFD2FB528
+#define ZSTD_SKIPPABLE_MAGIC	0x184D2A50	/* low 4 bits vary */
+
+/* Frame header descriptor.  */
+#define ZSTD_FHD_FCS_SHIFT	6
+#define ZSTD_FHD_SINGLE_SEGMENT	0x20
+#define ZSTD_FHD_RESERVED	0x08
+#define ZSTD_FHD_CHECKSUM	0x04
+#define ZSTD_FHD_DICT_ID_MASK	0x03
+
+#define ZSTD_BLOCK_MAX		(128 << 10)
+#define ZSTD_BLOCK_LAST		0x01
+#define ZSTD_BLOCK_RAW		0
+#define ZSTD_BLOCK_RLE		1
+#define ZSTD_BLOCK_COMPRESSED	2
+
+#define ZSTD_LIT_RAW		0
+#define ZSTD_LIT_RLE		1
+#define ZSTD_LIT_COMPRESSED	2
+#define ZSTD_LIT_TREELESS	3
+
+#define ZSTD_MODE_PREDEFINED	0
+#define ZSTD_MODE_RLE		1
+#define ZSTD_MODE_FSE		2
+#define ZSTD_MODE_REPEAT	3
+
+#define ZSTD_LL_SYMBOLS		36
+#define ZSTD_ML_SYMBOLS		53
+#define ZSTD_OF_SYMBOLS		32
+#define ZSTD_LL_LOG_MAX		9
+#define ZSTD_ML_LOG_MAX		9
+#define ZSTD_OF_LOG_MAX		8
+#define ZSTD_FSE_SYMBOLS_MAX	64
+#define ZSTD_FSE_LOG_MAX	9
+
+#define HUF_BITS_MAX		11
+#define HUF_SYMBOLS		256
+#define HUF_WEIGHT_LOG_MAX	6
+
+/* xxHash64 primes */
+#define XXH_PRIME64_1		11400714785074694791ULL
+#define XXH_PRIME64_2		14029467366897019727ULL
+#define XXH_PRIME64_3		1609587929392839161ULL
+#define XXH_PRIME64_4		9650029242287828579ULL
+#define XXH_PRIME64_5		2870177450012600261ULL
+
+/* The default distributions, for the predefined mode.  */
+static const short zstd_ll_default[ZSTD_LL_SYMBOLS] =
+{
+  4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+  -1, -1, -1, -1
+};
+
+static const short zstd_ml_default[ZSTD_ML_SYMBOLS] =
+{
+  1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+  -1, -1, -1, -1, -1
+};
+
+static const short zstd_of_default[29] =
+{
+  1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+/* The values the literal and match length codes stand for, and how many
+   extra bits follow them.  */
+static const unsigned int zstd_ll_base[ZSTD_LL_SYMBOLS] =
+{
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+  16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+  8192, 16384, 32768, 65536
+};
+
+static const unsigned char zstd_ll_bits[ZSTD_LL_SYMBOLS] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+  13, 14, 15, 16
+};
+
+static const unsigned int zstd_ml_base[ZSTD_ML_SYMBOLS] =
+{
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+  19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+  35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+  4099, 8195, 16387, 32771, 65539
+};
+
+static const unsigned char zstd_ml_bits[ZSTD_ML_SYMBOLS] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+  12, 13, 14, 15, 16
+};
+
+struct fse_entry
+{
+  unsigned char symbol;
+  unsigned char bits;
+  unsigned short base;
+};
+
+struct fse_table
+{
+  int log;		/* -1 until the frame has set the table */
+  struct fse_entry entry[1 << ZSTD_FSE_LOG_MAX];
+};
+
+struct huf_entry
+{
+  unsigned char symbol;
+  unsigned char bits;
+};
+
+/* A stream read backwards from its end, most significant bit first;
+   there are zeros before its start.  */
+struct zstd_bits
+{
+  const unsigned char *buf;
+  int pos;		/* bits left, negative once overread */
+};
+
+/* State carried from block to block within a frame.  */
+static struct
+{
+  struct fse_table ll;
+  struct fse_table of;
+  struct fse_table ml;
+
+  struct huf_entry huf[1 << HUF_BITS_MAX];
+  int huf_bits;		/* zero until a frame has a Huffman table */
+
+  unsigned int rep[3];
+} zstd;
+
+/* Room for one block of decoded literals.  */
+static unsigned char *zstd_literals;
+
+static unsigned long long
+get_le64 (const unsigned char *p)
+{
+  return DECOMP_GET_LE32 (p)
+    | ((unsigned long long) DECOMP_GET_LE32 (p + 4) << 32);
+}
+
+static int
+highbit (unsigned int x)
+{
+  int n = 0;
+
+  while (x >>= 1)
+    n++;
+  return n;
+}
+
+static unsigned long long
+rotl64 (unsigned long long x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static unsigned long long
+xxh64_round (unsigned long long acc, unsigned long long input)
+{
+  return rotl64 (acc + input * XXH_PRIME64_2, 31) * XXH_PRIME64_1;
+}
+
+static unsigned long long
+xxh64_merge (unsigned long long acc, unsigned long long v)
+{
+  return (acc ^ xxh64_round (0, v)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* The xxHash64 of LEN bytes at P with a seed of zero.  */
+static unsigned long long
+xxh64 (const unsigned char *p, unsigned int len)
+{
+  const unsigned char *end = p + len;
+  unsigned long long h;
+
+  if (len >= 32)
+    {
+      unsigned long long v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+      unsigned long long v2 = XXH_PRIME64_2;
+      unsigned long long v3 = 0;
+      unsigned long long v4 = - XXH_PRIME64_1;
+
+      do
+	{
+	  v1 = xxh64_round (v1, get_le64 (p));
+	  v2 = xxh64_round (v2, get_le64 (p + 8));
+	  v3 = xxh64_round (v3, get_le64 (p + 16));
+	  v4 = xxh64_round (v4, get_le64 (p + 24));
+	  p += 32;
+	}
+      while (end - p >= 32);
+
+      h = rotl64 (v1, 1) + rotl64 (v2, 7) + rotl64 (v3, 12) + rotl64 (v4, 18);
+      h = xxh64_merge (h, v1);
+      h = xxh64_merge (h, v2);
+      h = xxh64_merge (h, v3);
+      h = xxh64_merge (h, v4);
+    }
+  else
+    h = XXH_PRIME64_5;
+
+  h += len;
+
+  for (; end - p >= 8; p += 8)
+    h = rotl64 (h ^ xxh64_round (0, get_le64 (p)), 27) * XXH_PRIME64_1
+      + XXH_PRIME64_4;
+  if (end - p >= 4)
+    {
+      h = rotl64 (h ^ (DECOMP_GET_LE32 (p) * XXH_PRIME64_1), 23) * XXH_PRIME64_2
+	+ XXH_PRIME64_3;
+      p += 4;
+    }
+  for (; p < end; p++)
+    h = rotl64 (h ^ (*p * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+static int
+zstd_bits_init (struct zstd_bits *bs, const unsigned char *p, int len)
+{
+  if (len < 1 || p[len - 1] == 0)
+    return 0;
+
+  bs->buf = p;
+  bs->pos = (len - 1) * 8 + highbit (p[len - 1]);
+  return 1;
+}
+
+/* The next N bits, up to 32 of them.  */
+static unsigned int
+zstd_bits_peek (struct zstd_bits *bs, int n)
+{
+  unsigned long long window = 0;
+  int lo = bs->pos - n;
+  int start = lo < 0 ? 0 : lo;
+  int i;
+
+  if (bs->pos <= 0 || n == 0)
+    return 0;
+
+  for (i = (bs->pos - 1) >> 3; i >= start >> 3; i--)
+    window = (window << 8) | bs->buf[i];
+  window = (window >> (start & 7)) & ((1ULL << (bs->pos - start)) - 1);
+
+  return window << (start - lo);
+}
+
+static unsigned int
+zstd_bits_read (struct zstd_bits *bs, int n)
+{
+  unsigned int v = zstd_bits_peek (bs, n);
+
+  bs->pos -= n;
+  return v;
+}
+
+/* Read N bits forwards from the LEN bytes at P, starting at bit *POS;
+   there are zeros past the end.  */
+static unsigned int
+zstd_bits_forward (const unsigned char *p, int len, int *pos, int n)
+{
+  unsigned int v = 0;
+  int i;
+
+  for (i = 0; i < n; i++, (*pos)++)
+    if ((*pos >> 3) < len && ((p[*pos >> 3] >> (*pos & 7)) & 1))
+      v |= 1 << i;
+
+  return v;
+}
+
+/* Build the decoding table T of accuracy LOG for the NSYM symbols whose
+   normalized counts are NORM, -1 standing for a "less than one"
+   probability.  */
+static int
+fse_build (struct fse_table *t, const short *norm, int nsym, int log)
+{
+  unsigned short next[ZSTD_FSE_SYMBOLS_MAX];
+  unsigned int size = 1 << log;
+  unsigned int high = size - 1;
+  unsigned int step = (size >> 1) + (size >> 3) + 3;
+  unsigned int pos = 0, i;
+  int s, n;
+
+  for (s = 0; s < nsym; s++)
+    {
+      if (norm[s] == -1)
+	{
+	  t->entry[high--].symbol = s;
+	  next[s] = 1;
+	}
+      else
+	next[s] = norm[s];
+    }
+
+  /* spread the other symbols over the table */
+  for (s = 0; s < nsym; s++)
+    for (n = 0; n < norm[s]; n++)
+      {
+	t->entry[pos].symbol = s;
+	do
+	  pos = (pos + step) & (size - 1);
+	while (pos > high);
+      }
+  if (pos != 0)
+    return 0;
+
+  for (i = 0; i < size; i++)
+    {
+      struct fse_entry *e = &t->entry[i];
+      unsigned int state = next[e->symbol]++;
+
+      e->bits = log - highbit (state);
+      e->base = (state << e->bits) - size;
+    }
+
+  t->log = log;
+  return 1;
+}
+
+/* Read the table description at *PP, which must not go past END, for
+   at most NSYM symbols and an accuracy of at most MAX_LOG.  */
+static int
+fse_read (struct fse_table *t, const unsigned char **pp,
+	  const unsigned char *end, int nsym, int max_log)
+{
+  const unsigned char *p = *pp;
+  int len = end - p;
+  short norm[ZSTD_FSE_SYMBOLS_MAX];
+  int bit = 0, log, remaining, threshold, bits, s = 0;
+
+  log = zstd_bits_forward (p, len, &bit, 4) + 5;
+  if (log > max_log)
+    return 0;
+
+  remaining = (1 << log) + 1;
+  threshold = 1 << log;
+  bits = log + 1;
+
+  while (remaining > 1)
+    {
+      int max = 2 * threshold - 1 - remaining;
+      int start = bit;
+      int count;
+
+      if (s >= nsym)
+	return 0;
+
+      count = zstd_bits_forward (p, len, &bit, bits - 1);
+      if (count >= max)
+	{
+	  bit = start;
+	  count = zstd_bits_forward (p, len, &bit, bits);
+	  if (count >= threshold)
+	    count -= max;
+	}
+
+      /* the count is stored plus one, so that -1 fits */
+      count--;
+      remaining -= count < 0 ? -count : count;
+      norm[s++] = count;
+
+      /* a zero count is followed by how many more zeros there are */
+      if (count == 0)
+	{
+	  int repeat, n;
+
+	  do
+	    {
+	      repeat = zstd_bits_forward (p, len, &bit, 2);
+	      for (n = 0; n < repeat; n++)
+		{
+		  if (s >= nsym)
+		    return 0;
+		  norm[s++] = 0;
+		}
+	    }
+	  while (repeat == 3);
+	}
+
+      while (remaining < threshold)
+	{
+	  bits--;
+	  threshold >>= 1;
+	}
+    }
+
+  if (remaining != 1 || (bit + 7) / 8 > len)
+    return 0;
+
+  while (s < nsym)
+    norm[s++] = 0;
+
+  *pp = p + (bit + 7) / 8;
+  return fse_build (t, norm, nsym, log);
+}
+
+/* Decode the Huffman weights compressed with FSE in the LEN bytes at P
+   into WEIGHTS, returning how many there are.  */
+static int
+huf_read_fse_weights (const unsigned char *p, int len,
+		      unsigned char *weights)
+{
+  static struct fse_table t;
+  const unsigned char *end = p + len;
+  struct zstd_bits bs;
+  unsigned int state1, state2;
+  int n = 0;
+
+  if (! fse_read (&t, &p, end, HUF_BITS_MAX + 1, HUF_WEIGHT_LOG_MAX)
+      || ! zstd_bits_init (&bs, p, end - p))
+    return 0;
+
+  /* two interleaved states share the stream, which ends once updating
+     a state would need bits that are not there */
+  state1 = zstd_bits_read (&bs, t.log);
+  state2 = zstd_bits_read (&bs, t.log);
+  while (1)
+    {
+      if (n >= HUF_SYMBOLS - 1)
+	return 0;
+      weights[n++] = t.entry[state1].symbol;
+      state1 = t.entry[state1].base
+	+ zstd_bits_read (&bs, t.entry[state1].bits);
+      if (bs.pos < 0)
+	{
+	  weights[n++] = t.entry[state2].symbol;
+	  break;
+	}
+
+      if (n >= HUF_SYMBOLS - 1)
+	return 0;
+      weights[n++] = t.entry[state2].symbol;
+      state2 = t.entry[state2].base
+	+ zstd_bits_read (&bs, t.entry[state2].bits);
+      if (bs.pos < 0)
+	{
+	  weights[n++] = t.entry[state1].symbol;
+	  break;
+	}
+    }
+
+  return n;
+}
+
+/* Read the Huffman tree description at *PP, which must not go past
+   END, and build the decoding table from it.  */
+static int
+huf_read (const unsigned char **pp, const unsigned char *end)
+{
+  const unsigned char *p = *pp;
+  unsigned char weights[HUF_SYMBOLS];
+  unsigned int rank[HUF_BITS_MAX + 2];
+  unsigned int total = 0, rest, len;
+  int header, n, i, w, bits;
+
+  if (p >= end)
+    return 0;
+  header = *p++;
+
+  if (header >= 128)
+    {
+      /* four bits per weight */
+      n = header - 127;
+      if ((n + 1) / 2 > end - p)
+	return 0;
+      for (i = 0; i < n; i++)
+	weights[i] = i & 1 ? p[i / 2] & 15 : p[i / 2] >> 4;
+      p += (n + 1) / 2;
+    }
+  else
+    {
+      if (header > end - p)
+	return 0;
+      n = huf_read_fse_weights (p, header, weights);
+      if (! n)
+	return 0;
+      p += header;
+    }
+
+  /* the weight of the last symbol is whatever brings the total up to a
+     power of two */
+  for (i = 0; i < n; i++)
+    {
+      if (weights[i] > HUF_BITS_MAX)
+	return 0;
+      if (weights[i])
+	total += 1 << (weights[i] - 1);
+    }
+  if (! total)
+    return 0;
+
+  bits = highbit (total) + 1;
+  if (bits > HUF_BITS_MAX)
+    return 0;
+  rest = (1 << bits) - total;
+  if (rest & (rest - 1))
+    return 0;
+  weights[n++] = highbit (rest) + 1;
+
+  /* codes go to the lightest symbols first, in symbol order */
+  grub_memset (rank, 0, sizeof (rank));
+  for (i = 0; i < n; i++)
+    rank[weights[i]]++;
+  for (w = 1, len = 0; w <= bits; w++)
+    {
+      unsigned int count = rank[w];
+
+      rank[w] = len;
+      len += count << (w - 1);
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      unsigned int j;
+
+      w = weights[i];
+      if (! w)
+	continue;
+      for (j = 0; j < 1U << (w - 1); j++)
+	{
+	  zstd.huf[rank[w] + j].symbol = i;
+	  zstd.huf[rank[w] + j].bits = bits + 1 - w;
+	}
+      rank[w] += 1 << (w - 1);
+    }
+
+  zstd.huf_bits = bits;
+  *pp = p;
+  return 1;
+}
+
+/* Decode N literals from the Huffman stream of LEN bytes at P.  */
+static int
+huf_decode (const unsigned char *p, int len, unsigned char *out, int n)
+{
+  struct zstd_bits bs;
+
+  if (! zstd_bits_init (&bs, p, len))
+    return 0;
+
+  while (n--)
+    {
+      struct huf_entry *e = &zstd.huf[zstd_bits_peek (&bs, zstd.huf_bits)];
+
+      *out++ = e->symbol;
+      bs.pos -= e->bits;
+    }
+
+  return bs.pos == 0;
+}
+
+/* Decode the literals section at *PP, which must not go past END, and
+   point *LIT at them.  */
+static int
+zstd_read_literals (const unsigned char **pp, const unsigned char *end,
+		    const unsigned char **lit, int *lit_len, int block_max)
+{
+  const unsigned char *p = *pp;
+  unsigned int type, format, regen, size;
+  unsigned long long h;
+  int header_len, streams, i;
+
+  if (p >= end)
+    return 0;
+  type = p[0] & 3;
+  format = (p[0] >> 2) & 3;
+
+  if (type == ZSTD_LIT_RAW || type == ZSTD_LIT_RLE)
+    {
+      /* 5, 12 or 20 bits of size */
+      header_len = format == 1 ? 2 : format == 3 ? 3 : 1;
+      if (end - p < header_len)
+	return 0;
+      if (header_len == 1)
+	regen = p[0] >> 3;
+      else
+	{
+	  regen = (p[0] >> 4) | (p[1] << 4);
+	  if (header_len == 3)
+	    regen |= p[2] << 12;
+	}
+      p += header_len;
+
+      if (regen > (unsigned int) block_max)
+	return 0;
+
+      if (type == ZSTD_LIT_RAW)
+	{
+	  if (regen > (unsigned int) (end - p))
+	    return 0;
+	  *lit = p;
+	  p += regen;
+	}
+      else
+	{
+	  if (p >= end)
+	    return 0;
+	  grub_memset (zstd_literals, *p++, regen);
+	  *lit = zstd_literals;
+	}
+
+      *lit_len = regen;
+      *pp = p;
+      return 1;
+    }
+
+  /* the regenerated and compressed sizes take 10, 10, 14 or 18 bits
+     each, and all but the first format have four streams */
+  header_len = format < 2 ? 3 : format + 2;
+  if (end - p < header_len)
+    return 0;
+  for (h = 0, i = header_len - 1; i >= 0; i--)
+    h = (h << 8) | p[i];
+  i = format < 2 ? 10 : format == 2 ? 14 : 18;
+  regen = (h >> 4) & ((1 << i) - 1);
+  size = (h >> (4 + i)) & ((1 << i) - 1);
+  streams = format == 0 ? 1 : 4;
+  p += header_len;
+
+  if (regen > (unsigned int) block_max || size > (unsigned int) (end - p))
+    return 0;
+  end = p + size;
+
+  if (type == ZSTD_LIT_COMPRESSED)
+    {
+      if (! huf_read (&p, end))
+	return 0;
+    }
+  else if (! zstd.huf_bits)
+    return 0;
+
+  if (streams == 1)
+    {
+      if (! huf_decode (p, end - p, zstd_literals, regen))
+	return 0;
+    }
+  else
+    {
+      /* a jump table with the sizes of the first three streams */
+      const unsigned char *stream = p + 6;
+      unsigned int seg = (regen + 3) / 4;
+      unsigned char *out = zstd_literals;
+
+      if (end - p < 6 || regen < 3 * seg)
+	return 0;
+
+      for (i = 0; i < 4; i++)
+	{
+	  unsigned int len, n;
+
+	  if (i < 3)
+	    {
+	      len = p[2 * i] | (p[2 * i + 1] << 8);
+	      if (len > (unsigned int) (end - stream))
+		return 0;
+	      n = seg;
+	    }
+	  else
+	    {
+	      len = end - stream;
+	      n = regen - 3 * seg;
+	    }
+
+	  if (! huf_decode (stream, len, out, n))
+	    return 0;
+	  stream += len;
+	  out += n;
+	}
+    }
+
+  *lit = zstd_literals;
+  *lit_len = regen;
+  *pp = end;
+  return 1;
+}
+
+/* Set up the table T for MODE, reading its description at *PP, which
+   must not go past END, if it has one.  DEF holds the NDEF counts of
+   the predefined distribution of accuracy DEF_LOG.  */
+static int
+zstd_read_table (struct fse_table *t, int mode, const unsigned char **pp,
+		 const unsigned char *end, const short *def, int ndef,
+		 int def_log, int nsym, int max_log)
+{
+  switch (mode)
+    {
+    case ZSTD_MODE_PREDEFINED:
+      return fse_build (t, def, ndef, def_log);
+
+    case ZSTD_MODE_RLE:
+      if (*pp >= end || **pp >= nsym)
+	return 0;
+      t->log = 0;
+      t->entry[0].symbol = *(*pp)++;
+      t->entry[0].bits = 0;
+      t->entry[0].base = 0;
+      return 1;
+
+    case ZSTD_MODE_FSE:
+      return fse_read (t, pp, end, nsym, max_log);
+    }
+
+  /* repeat the table of the last block that had sequences */
+  return t->log >= 0;
+}
+
+/* Decode the sequences section at P, which ends at END, and carry the
+   sequences out with the LIT_LEN literals at LIT, producing at most
+   BLOCK_MAX bytes.  */
+static int
+zstd_read_sequences (const unsigned char *p, const unsigned char *end,
+		     const unsigned char *lit, int lit_len, int frame_start,
+		     int block_max)
+{
+  const unsigned char *lit_end = lit + lit_len;
+  unsigned char *out = decomp_data + decomp_size;
+  unsigned char *out_end = out + block_max;
+  unsigned int nseq;
+
+  if (p >= end)
+    return 0;
+  nseq = *p++;
+  if (nseq == 255)
+    {
+      if (end - p < 2)
+	return 0;
+      nseq = p[0] + (p[1] << 8) + 0x7F00;
+      p += 2;
+    }
+  else if (nseq >= 128)
+    {
+      if (p >= end)
+	return 0;
+      nseq = ((nseq - 128) << 8) + *p++;
+    }
+
+  if (nseq)
+    {
+      struct zstd_bits bs;
+      unsigned int modes, ll_state, of_state, ml_state;
+
+      if (p >= end)
+	return 0;
+      modes = *p++;
+      if ((modes & 3)
+	  || ! zstd_read_table (&zstd.ll, modes >> 6, &p, end,
+				zstd_ll_default, ZSTD_LL_SYMBOLS, 6,
+				ZSTD_LL_SYMBOLS, ZSTD_LL_LOG_MAX)
+	  || ! zstd_read_table (&zstd.of, (modes >> 4) & 3, &p, end,
+				zstd_of_default,
+				sizeof (zstd_of_default)
+				/ sizeof (zstd_of_default[0]), 5,
+				ZSTD_OF_SYMBOLS, ZSTD_OF_LOG_MAX)
+	  || ! zstd_read_table (&zstd.ml, (modes >> 2) & 3, &p, end,
+				zstd_ml_default, ZSTD_ML_SYMBOLS, 6,
+				ZSTD_ML_SYMBOLS, ZSTD_ML_LOG_MAX)
+	  || ! zstd_bits_init (&bs, p, end - p))
+	return 0;
+
+      ll_state = zstd_bits_read (&bs, zstd.ll.log);
+      of_state = zstd_bits_read (&bs, zstd.of.log);
+      ml_state = zstd_bits_read (&bs, zstd.ml.log);
+
+      while (nseq--)
+	{
+	  struct fse_entry *ll_e = &zstd.ll.entry[ll_state];
+	  struct fse_entry *of_e = &zstd.of.entry[of_state];
+	  struct fse_entry *ml_e = &zstd.ml.entry[ml_state];
+	  unsigned int offset, ll, ml;
+	  unsigned char *match;
+
+	  /* the extra bits come offset first */
+	  offset = (1U << of_e->symbol) + zstd_bits_read (&bs, of_e->symbol);
+	  ml = zstd_ml_base[ml_e->symbol]
+	    + zstd_bits_read (&bs, zstd_ml_bits[ml_e->symbol]);
+	  ll = zstd_ll_base[ll_e->symbol]
+	    + zstd_bits_read (&bs, zstd_ll_bits[ll_e->symbol]);
+
+	  /* 1 to 3 pick one of the last three offsets, shifted by one
+	     when there are no literals */
+	  if (offset > 3)
+	    {
+	      offset -= 3;
+	      zstd.rep[2] = zstd.rep[1];
+	      zstd.rep[1] = zstd.rep[0];
+	      zstd.rep[0] = offset;
+	    }
+	  else
+	    {
+	      unsigned int idx = offset - 1 + (ll == 0);
+
+	      if (idx == 0)
+		offset = zstd.rep[0];
+	      else
+		{
+		  offset = idx < 3 ? zstd.rep[idx] : zstd.rep[0] - 1;
+		  if (idx > 1)
+		    zstd.rep[2] = zstd.rep[1];
+		  zstd.rep[1] = zstd.rep[0];
+		  zstd.rep[0] = offset;
+		}
+	    }
+
+	  if (nseq)
+	    {
+	      ll_state = ll_e->base + zstd_bits_read (&bs, ll_e->bits);
+	      ml_state = ml_e->base + zstd_bits_read (&bs, ml_e->bits);
+	      of_state = of_e->base + zstd_bits_read (&bs, of_e->bits);
+	    }
+
+	  if (ll > (unsigned int) (lit_end - lit)
+	      || ll > (unsigned int) (out_end - out))
+	    return 0;
+	  grub_memmove (out, lit, ll);
+	  out += ll;
+	  lit += ll;
+
+	  if (offset == 0
+	      || offset > (unsigned int) (out - (decomp_data + frame_start))
+	      || ml > (unsigned int) (out_end - out))
+	    return 0;
+
+	  /* byte by byte, since the match may overlap its own output */
+	  match = out - offset;
+	  while (ml--)
+	    *out++ = *match++;
+	}
+
+      if (bs.pos != 0)
+	return 0;
+    }
+  else if (p != end)
+    return 0;
+
+  /* the literals left over go last */
+  if (lit_end - lit > out_end - out)
+    return 0;
+  grub_memmove (out, lit, lit_end - lit);
+  out += lit_end - lit;
+
+  decomp_size = out - decomp_data;
+  return 1;
+}
+
+/* Decode the frame starting at *PP, which must not go past END.  */
+static int
+zstd_decode_frame (const unsigned char **pp, const unsigned char *end)
+{
+  static const int dict_id_len[4] = { 0, 1, 2, 4 };
+  static const int fcs_len[4] = { 0, 2, 4, 8 };
+  const unsigned char *p = *pp + 4;
+  unsigned long long window = 0, content_size = 0;
+  unsigned int fhd, dict_id = 0;
+  int single, fcs, block_max, frame_start, last, i;
+
+  if (p >= end)
+    goto fail;
+  fhd = *p++;
+  if (fhd & ZSTD_FHD_RESERVED)
+    goto bad_header;
+
+  single = fhd & ZSTD_FHD_SINGLE_SEGMENT;
+  fcs = fcs_len[fhd >> ZSTD_FHD_FCS_SHIFT];
+  if (single && ! fcs)
+    fcs = 1;
+  if (end - p < ! single + dict_id_len[fhd & ZSTD_FHD_DICT_ID_MASK] + fcs)
+    goto fail;
+
+  if (! single)
+    {
+      unsigned int log = 10 + (*p >> 3);
+
+      window = (1ULL << log) + ((1ULL << log) >> 3) * (*p & 7);
+      p++;
+    }
+
+  for (i = 0; i < dict_id_len[fhd & ZSTD_FHD_DICT_ID_MASK]; i++)
+    dict_id |= *p++ << (8 * i);
+  /* there is no way to hand us the dictionary */
+  if (dict_id)
+    goto bad_header;
+
+  for (i = 0; i < fcs; i++)
+    content_size |= (unsigned long long) *p++ << (8 * i);
+  if (fcs == 2)
+    content_size += 256;
+
+  if (single)
+    window = content_size;
+  block_max = window < ZSTD_BLOCK_MAX ? (int) window : ZSTD_BLOCK_MAX;
+
+  if (fcs && ! decomp_expect (content_size))
+    return 0;
+
+  frame_start = decomp_size;
+  zstd.rep[0] = 1;
+  zstd.rep[1] = 4;
+  zstd.rep[2] = 8;
+  zstd.ll.log = zstd.of.log = zstd.ml.log = -1;
+  zstd.huf_bits = 0;
+
+  do
+    {
+      unsigned int header, size;
+      int max = block_max;
+
+      /* never make room for more than the frame says is left */
+      if (fcs && content_size - (decomp_size - frame_start)
+	  < (unsigned long long) max)
+	max = content_size - (decomp_size - frame_start);
+
+      if (end - p < 3)
+	goto fail;
+      header = p[0] | (p[1] << 8) | (p[2] << 16);
+      p += 3;
+      last = header & ZSTD_BLOCK_LAST;
+      size = header >> 3;
+      if (size > (unsigned int) block_max)
+	goto fail;
+
+      switch ((header >> 1) & 3)
+	{
+	case ZSTD_BLOCK_RAW:
+	  if (size > (unsigned int) max || size > (unsigned int) (end - p)
+	      || ! decomp_reserve (size))
+	    goto fail;
+	  grub_memmove (decomp_data + decomp_size, p, size);
+	  decomp_size += size;
+	  p += size;
+	  break;
+
+	case ZSTD_BLOCK_RLE:
+	  if (size > (unsigned int) max || p >= end || ! decomp_reserve (size))
+	    goto fail;
+	  grub_memset (decomp_data + decomp_size, *p++, size);
+	  decomp_size += size;
+	  break;
+
+	case ZSTD_BLOCK_COMPRESSED:
+	  {
+	    const unsigned char *lit, *q = p;
+	    int lit_len;
+
+	    if (size > (unsigned int) (end - p) || ! decomp_reserve (max)
+		|| ! zstd_read_literals (&q, p + size, &lit, &lit_len,
+					 block_max)
+		|| ! zstd_read_sequences (q, p + size, lit, lit_len,
+					  frame_start, max))
+	      goto fail;
+	    p += size;
+	  }
+	  break;
+
+	default:
+	  goto fail;
+	}
+    }
+  while (! last);
+
+  if (fcs && content_size != (unsigned long long) (decomp_size - frame_start))
+    goto fail;
+
+  /* the low 32 bits of the xxHash64 of the content */
+  if (fhd & ZSTD_FHD_CHECKSUM)
+    {
+      if (end - p < 4)
+	goto fail;
+      if ((unsigned int) xxh64 (decomp_data + frame_start,
+				decomp_size - frame_start) != DECOMP_GET_LE32 (p))
+	{
+	  errnum = ERR_BAD_GZIP_CRC;
+	  return 0;
+	}
+      p += 4;
+    }
+
+  *pp = p;
+  return 1;
+
+ bad_header:
+  errnum = ERR_BAD_GZIP_HEADER;
+  return 0;
+
+ fail:
+  if (! errnum)
+    errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+int
+unzstd_test (unsigned char *buf, int len)
+{
+  return len >= 4 && DECOMP_GET_LE32 (buf) == ZSTD_MAGIC;
+}
+
+int
+unzstd_decode (const unsigned char *src, int size)
+{
+  const unsigned char *p = src;
+  const unsigned char *end = src + size;
+
+  zstd_literals = grub_malloc (ZSTD_BLOCK_MAX);
+  if (! zstd_literals)
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  /* a file may hold several frames, and skippable frames among them */
+  while (end - p >= 4 && ! errnum)
+    {
+      unsigned int magic = DECOMP_GET_LE32 (p);
+
+      if (magic == ZSTD_MAGIC)
+	zstd_decode_frame (&p, end);
+      else if ((magic & 0xFFFFFFF0) == ZSTD_SKIPPABLE_MAGIC
+	       && end - p >= 8
+	       && DECOMP_GET_LE32 (p + 4) <= (unsigned int) (end - p - 8))
+	p += 8 + DECOMP_GET_LE32 (p + 4);
+      else
+	break;
+    }
+
+  grub_free (zstd_literals);
+  zstd_literals = 0;
+  return ! errnum;
+}
+
+#endif /* PLATFORM_EFI && ! NO_DECOMPRESSION */